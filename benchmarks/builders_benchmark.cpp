@@ -0,0 +1,93 @@
+#include <algorithm>
+#include <string>
+
+#include <folly/Benchmark.h>
+#include <folly/Conv.h>
+#include <folly/init/Init.h>
+#include <folly/io/IOBufQueue.h>
+
+#include "redis/builders.h"
+
+namespace
+{
+    //HGETALL/ZRANGE WITHSCORES 形式的回包: n个bulk string组成的数组
+    std::string flatArray(std::size_t n)
+    {
+        std::string data = folly::to<std::string>("*", n, "\r\n");
+        for (std::size_t i = 0; i < n; i++) {
+            auto field = folly::to<std::string>("field:", i);
+            folly::toAppend("$", field.size(), "\r\n", field, "\r\n", &data);
+        }
+        return data;
+    }
+
+    //XREAD 形式的回包: [[stream,[[id,[k,v,...]],...]]]
+    std::string nestedArray(std::size_t entries)
+    {
+        std::string data = folly::to<std::string>("*1\r\n*2\r\n$6\r\nstream\r\n*", entries, "\r\n");
+        for (std::size_t i = 0; i < entries; i++) {
+            auto id = folly::to<std::string>(i, "-0");
+            folly::toAppend("*2\r\n$", id.size(), "\r\n", id, "\r\n*4\r\n$1\r\nk\r\n:", i, "\r\n$1\r\nv\r\n:", i, "\r\n", &data);
+        }
+        return data;
+    }
+
+    //按chunk字节分批到达, 模拟Conn的多次读
+    std::size_t parse(const std::string& data, std::size_t chunk)
+    {
+        folly::IOBufQueue buf(folly::IOBufQueue::cacheChainLength());
+        redis::ReplyBuilder builder(buf);
+        for (std::size_t pos = 0; pos < data.size(); pos += chunk) {
+            buf.append(data.data() + pos, std::min(chunk, data.size() - pos));
+            while (builder.Build());
+        }
+        std::size_t n = 0;
+        while (builder.IsReplyAvailable()) {
+            n += builder.TakeFront().AsArray().size();
+        }
+        return n;
+    }
+}
+
+//每个iteration是一个数组元素, 输出的iters/s即元素每秒
+BENCHMARK_MULTI(FlatArray_10k_Contiguous, n)
+{
+    std::string data;
+    BENCHMARK_SUSPEND { data = flatArray(10000); }
+    std::size_t elements = 0;
+    for (unsigned i = 0; i < n; i++) {
+        elements += parse(data, data.size());
+    }
+    return elements;
+}
+
+BENCHMARK_MULTI(FlatArray_10k_Chunked1024, n)
+{
+    std::string data;
+    BENCHMARK_SUSPEND { data = flatArray(10000); }
+    std::size_t elements = 0;
+    for (unsigned i = 0; i < n; i++) {
+        elements += parse(data, 1024);
+    }
+    return elements;
+}
+
+BENCHMARK_MULTI(NestedArray_1k_Chunked1024, n)
+{
+    std::string data;
+    BENCHMARK_SUSPEND { data = nestedArray(1000); }
+    std::size_t elements = 0;
+    for (unsigned i = 0; i < n; i++) {
+        //每个entry有 id, fields, 4个字段 共7个节点
+        parse(data, 1024);
+        elements += 1000 * 7;
+    }
+    return elements;
+}
+
+int main(int argc, char** argv)
+{
+    folly::Init init(&argc, &argv);
+    folly::runBenchmarks();
+    return 0;
+}
@@ -0,0 +1,102 @@
+#include <string>
+#include <vector>
+
+#include <folly/Benchmark.h>
+#include <folly/Conv.h>
+#include <folly/init/Init.h>
+
+#include "redis/command.h"
+
+namespace
+{
+    //每个iteration构造一个BATCH条命令的pipeline
+    constexpr std::size_t BATCH = 1000;
+
+    std::vector<std::string> makeKeys(const char* prefix)
+    {
+        std::vector<std::string> keys;
+        keys.reserve(BATCH);
+        for (std::size_t i = 0; i < BATCH; i++) {
+            keys.emplace_back(folly::to<std::string>(prefix, i));
+        }
+        return keys;
+    }
+
+    template <class F>
+    std::size_t build(const std::vector<std::string>& keys, F&& f)
+    {
+        auto cmd = redis::Command::Create(true);
+        for (auto& key : keys) {
+            f(cmd, key);
+        }
+        cmd.Build();
+        folly::doNotOptimizeAway(cmd.Commands().size());
+        return keys.size();
+    }
+}
+
+//输出的iters/s即每秒构造的命令数
+BENCHMARK_MULTI(Get_Runtime)
+{
+    std::vector<std::string> keys;
+    BENCHMARK_SUSPEND { keys = makeKeys("user:"); }
+    return build(keys, [](redis::Command& cmd, const std::string& key) {
+        cmd.Cmd("GET").Key(key);
+    });
+}
+
+BENCHMARK_RELATIVE_MULTI(Get_Prefix)
+{
+    std::vector<std::string> keys;
+    BENCHMARK_SUSPEND { keys = makeKeys("user:"); }
+    return build(keys, [](redis::Command& cmd, const std::string& key) {
+        cmd.Get(key);
+    });
+}
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_MULTI(Set_Runtime)
+{
+    std::vector<std::string> keys;
+    BENCHMARK_SUSPEND { keys = makeKeys("user:"); }
+    return build(keys, [](redis::Command& cmd, const std::string& key) {
+        cmd.Cmd("SET").Key(key).Arg("value");
+    });
+}
+
+BENCHMARK_RELATIVE_MULTI(Set_Prefix)
+{
+    std::vector<std::string> keys;
+    BENCHMARK_SUSPEND { keys = makeKeys("user:"); }
+    return build(keys, [](redis::Command& cmd, const std::string& key) {
+        cmd.Set(key, "value");
+    });
+}
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_MULTI(HIncrBy_Runtime)
+{
+    std::vector<std::string> keys;
+    BENCHMARK_SUSPEND { keys = makeKeys("stats:"); }
+    return build(keys, [](redis::Command& cmd, const std::string& key) {
+        cmd.Cmd("HINCRBY").Key(key).Arg("field").Arg(1);
+    });
+}
+
+BENCHMARK_RELATIVE_MULTI(HIncrBy_Prefix)
+{
+    std::vector<std::string> keys;
+    BENCHMARK_SUSPEND { keys = makeKeys("stats:"); }
+    return build(keys, [](redis::Command& cmd, const std::string& key) {
+        cmd.HIncrby(key, "field", 1);
+    });
+}
+
+int main(int argc, char** argv)
+{
+    folly::Init init(&argc, &argv);
+    folly::runBenchmarks();
+    return 0;
+}
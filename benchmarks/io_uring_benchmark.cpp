@@ -0,0 +1,95 @@
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <folly/Benchmark.h>
+#include <folly/executors/CPUThreadPoolExecutor.h>
+#include <folly/futures/Future.h>
+#include <folly/init/Init.h>
+#include <folly/logging/xlog.h>
+#include <folly/portability/GFlags.h>
+
+#include "redis/io_pool.h"
+#include "redis/pool_client.h"
+
+//需要一个本地的redis
+DEFINE_string(host, "127.0.0.1", "redis host");
+DEFINE_int32(port, 6379, "redis port");
+DEFINE_int32(io_threads, 2, "threads of each io pool");
+DEFINE_int32(conns, 4, "connections of each client");
+DEFINE_int32(depth, 256, "pipelined commands waiting at the same time");
+
+namespace
+{
+    folly::CPUThreadPoolExecutor& executor()
+    {
+        static folly::CPUThreadPoolExecutor exec(1);
+        return exec;
+    }
+
+    //每种后端的线程池和客户端只建立一次, 一直持有到进程退出
+    std::shared_ptr<redis::PoolClient> client(redis::IOBackend backend)
+    {
+        static std::map<redis::IOBackend, std::shared_ptr<folly::IOExecutor>> pools;
+        static std::map<redis::IOBackend, std::shared_ptr<redis::PoolClient>> clients;
+        auto& client = clients[backend];
+        if (!client) {
+            redis::IOPoolOptions options;
+            options.backend = backend;
+            options.threads = static_cast<std::size_t>(FLAGS_io_threads);
+            pools[backend] = redis::MakeIOPool(options);
+            redis::SetIOPool(pools[backend]);
+            client = std::make_shared<redis::PoolClient>(&executor(), static_cast<std::size_t>(FLAGS_conns));
+            client->SetInlineCompletion(true);
+            client->SetAutoPipeline(true);
+            client->Connect(FLAGS_host, FLAGS_port).get();
+            redis::SetIOPool(nullptr);
+        }
+        return client;
+    }
+
+    //保持depth个命令在途, 共n个, set为true时SET否则GET
+    void pipelined(unsigned n, redis::IOBackend backend, bool set)
+    {
+        std::shared_ptr<redis::PoolClient> c;
+        BENCHMARK_SUSPEND { c = client(backend); }
+        const auto depth = static_cast<unsigned>(FLAGS_depth);
+        std::vector<folly::Future<redis::Reply>> futures;
+        futures.reserve(depth);
+        for (unsigned i = 0; i < n; i++) {
+            if (set) {
+                futures.emplace_back(c->Cmd().Set("bench:io_uring", "value").Query());
+            } else {
+                futures.emplace_back(c->Cmd().Get("bench:io_uring").Query());
+            }
+            if (futures.size() == depth) {
+                folly::collectAll(std::move(futures)).get();
+                futures.clear();
+            }
+        }
+        folly::collectAll(std::move(futures)).get();
+    }
+
+    void epollGet(unsigned n) { pipelined(n, redis::IOBackend::Epoll, false); }
+    void ioUringGet(unsigned n) { pipelined(n, redis::IOBackend::IoUring, false); }
+    void epollSet(unsigned n) { pipelined(n, redis::IOBackend::Epoll, true); }
+    void ioUringSet(unsigned n) { pipelined(n, redis::IOBackend::IoUring, true); }
+}
+
+//每个iteration是一个命令
+BENCHMARK(Get_epoll, n) { epollGet(n); }
+BENCHMARK_RELATIVE(Get_io_uring, n) { ioUringGet(n); }
+BENCHMARK_DRAW_LINE();
+BENCHMARK(Set_epoll, n) { epollSet(n); }
+BENCHMARK_RELATIVE(Set_io_uring, n) { ioUringSet(n); }
+
+int main(int argc, char** argv)
+{
+    folly::Init init(&argc, &argv);
+    if (!redis::IoUringAvailable()) {
+        XLOG(ERR, "io_uring is not available");
+        return 1;
+    }
+    folly::runBenchmarks();
+    return 0;
+}
@@ -0,0 +1,78 @@
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <folly/Benchmark.h>
+#include <folly/Conv.h>
+#include <folly/executors/CPUThreadPoolExecutor.h>
+#include <folly/futures/Future.h>
+#include <folly/init/Init.h>
+#include <folly/portability/GFlags.h>
+
+#include "redis/pool_client.h"
+
+//需要一个可用的redis
+DEFINE_string(host, "127.0.0.1", "redis host");
+DEFINE_int32(port, 6379, "redis port");
+DEFINE_int32(submitters, 8, "threads submitting queries");
+
+namespace
+{
+    folly::CPUThreadPoolExecutor& executor()
+    {
+        static folly::CPUThreadPoolExecutor exec(4);
+        return exec;
+    }
+
+    //每种连接数的连接池只建立一次
+    std::shared_ptr<redis::PoolClient> pool(std::size_t size)
+    {
+        static std::map<std::size_t, std::shared_ptr<redis::PoolClient>> pools;
+        auto& client = pools[size];
+        if (!client) {
+            client = std::make_shared<redis::PoolClient>(&executor(), size);
+            client->SetInlineCompletion(true);
+            client->Connect(FLAGS_host, FLAGS_port).get();
+        }
+        return client;
+    }
+
+    //submitters个线程并发提交共n个GET, 全部完成为止
+    void throughput(unsigned n, std::size_t size)
+    {
+        std::shared_ptr<redis::PoolClient> client;
+        BENCHMARK_SUSPEND { client = pool(size); }
+        const auto threads = static_cast<std::size_t>(FLAGS_submitters);
+        std::vector<std::thread> submitters;
+        for (std::size_t t = 0; t < threads; t++) {
+            const std::size_t count = n / threads + (t < n % threads ? 1 : 0);
+            submitters.emplace_back([client, count, t] {
+                const auto key = folly::to<std::string>("bench:pool:", t);
+                std::vector<folly::Future<redis::Reply>> futures;
+                futures.reserve(count);
+                for (std::size_t i = 0; i < count; i++) {
+                    futures.emplace_back(client->Cmd().Get(key).Query());
+                }
+                folly::collectAll(std::move(futures)).get();
+            });
+        }
+        for (auto& t : submitters) {
+            t.join();
+        }
+    }
+}
+
+//每个iteration是一个GET
+BENCHMARK_NAMED_PARAM(throughput, 1_conn, 1)
+BENCHMARK_RELATIVE_NAMED_PARAM(throughput, 2_conns, 2)
+BENCHMARK_RELATIVE_NAMED_PARAM(throughput, 4_conns, 4)
+BENCHMARK_RELATIVE_NAMED_PARAM(throughput, 8_conns, 8)
+
+int main(int argc, char** argv)
+{
+    folly::Init init(&argc, &argv);
+    folly::runBenchmarks();
+    return 0;
+}
@@ -0,0 +1,184 @@
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <new>
+#include <string>
+
+#include <folly/Benchmark.h>
+#include <folly/Conv.h>
+#include <folly/init/Init.h>
+#include <folly/io/IOBufQueue.h>
+
+#include "redis/builders.h"
+
+namespace
+{
+    //统计堆分配的次数和字节数
+    std::atomic<std::size_t> allocations{0};
+    std::atomic<std::size_t> allocated{0};
+}
+
+void* operator new(std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    allocated.fetch_add(size, std::memory_order_relaxed);
+    if (void* p = std::malloc(size == 0 ? 1 : size))return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace
+{
+    std::string intArray(std::size_t n)
+    {
+        std::string data = folly::to<std::string>("*", n, "\r\n");
+        for (std::size_t i = 0; i < n; i++) {
+            folly::toAppend(":", i, "\r\n", &data);
+        }
+        return data;
+    }
+
+    std::string okReplies(std::size_t n)
+    {
+        std::string data;
+        for (std::size_t i = 0; i < n; i++) {
+            data += "+OK\r\n";
+        }
+        return data;
+    }
+
+    std::string bulkArray(std::size_t n)
+    {
+        std::string data = folly::to<std::string>("*", n, "\r\n");
+        for (std::size_t i = 0; i < n; i++) {
+            auto field = folly::to<std::string>("field:", i);
+            folly::toAppend("$", field.size(), "\r\n", field, "\r\n", &data);
+        }
+        return data;
+    }
+
+    //XREAD 形式的回包: [[stream,[[id,[k,v,...]],...]]]
+    std::string nestedArray(std::size_t entries)
+    {
+        std::string data = folly::to<std::string>("*1\r\n*2\r\n$6\r\nstream\r\n*", entries, "\r\n");
+        for (std::size_t i = 0; i < entries; i++) {
+            auto id = folly::to<std::string>(i, "-0");
+            folly::toAppend("*2\r\n$", id.size(), "\r\n", id, "\r\n*4\r\n$5\r\nfield\r\n$5\r\nvalue\r\n$3\r\nseq\r\n:", i, "\r\n", &data);
+        }
+        return data;
+    }
+
+    //解析出的reply全部保留, 返回reply(含数组元素)的个数
+    std::size_t drain(redis::ReplyBuilder& builder, std::deque<redis::Reply>& out)
+    {
+        std::size_t n = 0;
+        while (builder.Build()) {
+            auto rpl = builder.TakeFront();
+            n += rpl.IsAggregate() ? rpl.AsArray().size() : 1;
+            out.push_back(std::move(rpl));
+        }
+        return n;
+    }
+
+    std::size_t parse(const std::string& data, std::deque<redis::Reply>& out, bool arena = false)
+    {
+        folly::IOBufQueue buf(folly::IOBufQueue::cacheChainLength());
+        redis::ReplyBuilder builder(buf);
+        builder.SetArena(arena);
+        buf.append(data.data(), data.size());
+        return drain(builder, out);
+    }
+
+    //保留所有reply时每个reply占用的堆内存, 读缓冲的分配不计入
+    void report(const char* name, const std::string& data, bool arena = false)
+    {
+        std::deque<redis::Reply> out;
+        folly::IOBufQueue buf(folly::IOBufQueue::cacheChainLength());
+        redis::ReplyBuilder builder(buf);
+        builder.SetArena(arena);
+        buf.append(data.data(), data.size());
+        const auto count = allocations.load();
+        const auto before = allocated.load();
+        const auto n = drain(builder, out);
+        const auto bytes = allocated.load() - before;
+        std::printf("%-16s %8zu replies %8.1f bytes/reply %8zu allocations\n", name, n, static_cast<double>(bytes) / n, allocations.load() - count);
+    }
+}
+
+BENCHMARK_MULTI(IntArray_10k, n)
+{
+    std::string data;
+    BENCHMARK_SUSPEND { data = intArray(10000); }
+    std::size_t replies = 0;
+    for (unsigned i = 0; i < n; i++) {
+        std::deque<redis::Reply> out;
+        replies += parse(data, out);
+    }
+    return replies;
+}
+
+BENCHMARK_MULTI(SimpleOK_10k, n)
+{
+    std::string data;
+    BENCHMARK_SUSPEND { data = okReplies(10000); }
+    std::size_t replies = 0;
+    for (unsigned i = 0; i < n; i++) {
+        std::deque<redis::Reply> out;
+        replies += parse(data, out);
+    }
+    return replies;
+}
+
+BENCHMARK_MULTI(BulkArray_10k, n)
+{
+    std::string data;
+    BENCHMARK_SUSPEND { data = bulkArray(10000); }
+    std::size_t replies = 0;
+    for (unsigned i = 0; i < n; i++) {
+        std::deque<redis::Reply> out;
+        replies += parse(data, out);
+    }
+    return replies;
+}
+
+//解析加释放, 每个iteration是一个XREAD回包
+BENCHMARK(NestedArray_1k_Heap, n)
+{
+    std::string data;
+    BENCHMARK_SUSPEND { data = nestedArray(1000); }
+    for (unsigned i = 0; i < n; i++) {
+        std::deque<redis::Reply> out;
+        parse(data, out);
+    }
+}
+
+BENCHMARK_RELATIVE(NestedArray_1k_Arena, n)
+{
+    std::string data;
+    BENCHMARK_SUSPEND { data = nestedArray(1000); }
+    for (unsigned i = 0; i < n; i++) {
+        std::deque<redis::Reply> out;
+        parse(data, out, true);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    folly::Init init(&argc, &argv);
+    std::printf("sizeof(redis::Reply) = %zu\n", sizeof(redis::Reply));
+    report("IntArray_10k", intArray(10000));
+    report("SimpleOK_10k", okReplies(10000));
+    report("BulkArray_10k", bulkArray(10000));
+    report("Nested_1k_Heap", nestedArray(1000));
+    report("Nested_1k_Arena", nestedArray(1000), true);
+    folly::runBenchmarks();
+    return 0;
+}
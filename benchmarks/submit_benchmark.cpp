@@ -0,0 +1,87 @@
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <folly/Benchmark.h>
+#include <folly/Conv.h>
+#include <folly/init/Init.h>
+#include <folly/portability/GFlags.h>
+
+#include "redis/conn.h"
+
+//需要一个本地的redis
+DEFINE_string(host, "127.0.0.1", "redis host");
+DEFINE_int32(port, 6379, "redis port");
+
+namespace
+{
+    //每种设置的连接只建立一次, 一直持有到进程退出
+    std::shared_ptr<redis::Conn> conn(bool auto_pipeline)
+    {
+        static std::map<bool, std::shared_ptr<redis::Conn>> conns;
+        auto& c = conns[auto_pipeline];
+        if (!c) {
+            c = std::make_shared<redis::Conn>(redis::Conn::SINGLE);
+            c->SetAutoPipeline(auto_pipeline);
+            c->Connect(FLAGS_host, FLAGS_port).get();
+        }
+        return c;
+    }
+
+    //producers个线程同时用Conn::Run共提交n个SET, 从非IO线程提交都经过submissions_
+    void contend(unsigned n, std::size_t producers, bool auto_pipeline)
+    {
+        std::shared_ptr<redis::Conn> c;
+        std::atomic<bool> go{ false };
+        std::vector<std::thread> threads;
+        BENCHMARK_SUSPEND {
+            c = conn(auto_pipeline);
+            for (std::size_t p = 0; p < producers; p++) {
+                const std::size_t count = n / producers + (p < n % producers ? 1 : 0);
+                threads.emplace_back([c, &go, count, p] {
+                    const auto key = folly::to<std::string>("bench:submit:", p);
+                    while (!go.load(std::memory_order_acquire));
+                    for (std::size_t i = 0; i < count; i++) {
+                        c->Run(std::move(redis::Command::Create(false).Set(key, "value")));
+                    }
+                });
+            }
+        }
+        go.store(true, std::memory_order_release);
+        for (auto& t : threads) {
+            t.join();
+        }
+        //连接上的命令按顺序完成, 最后一个PING的回包到了说明前面的都完成了
+        c->Query(std::move(redis::Command::Create(false).Cmd("PING"))).get();
+    }
+
+    void direct(unsigned n, std::size_t producers)
+    {
+        contend(n, producers, false);
+    }
+    void autoPipeline(unsigned n, std::size_t producers)
+    {
+        contend(n, producers, true);
+    }
+}
+
+//每个iteration是一次提交
+BENCHMARK_NAMED_PARAM(direct, 1_producer, 1)
+BENCHMARK_RELATIVE_NAMED_PARAM(autoPipeline, 1_producer, 1)
+BENCHMARK_DRAW_LINE();
+BENCHMARK_NAMED_PARAM(direct, 4_producers, 4)
+BENCHMARK_RELATIVE_NAMED_PARAM(autoPipeline, 4_producers, 4)
+BENCHMARK_DRAW_LINE();
+BENCHMARK_NAMED_PARAM(direct, 16_producers, 16)
+BENCHMARK_RELATIVE_NAMED_PARAM(autoPipeline, 16_producers, 16)
+
+int main(int argc, char** argv)
+{
+    folly::Init init(&argc, &argv);
+    folly::runBenchmarks();
+    return 0;
+}
@@ -0,0 +1,75 @@
+#include <memory>
+#include <string>
+
+#include <folly/Benchmark.h>
+#include <folly/executors/CPUThreadPoolExecutor.h>
+#include <folly/futures/Future.h>
+#include <folly/init/Init.h>
+#include <folly/portability/GFlags.h>
+
+#include "redis/client.h"
+
+//需要一个同时监听tcp和unix socket的本地redis, 如 redis-server --port 6379 --unixsocket /tmp/redis.sock
+DEFINE_string(host, "127.0.0.1", "redis host");
+DEFINE_int32(port, 6379, "redis port");
+DEFINE_string(unixsocket, "/tmp/redis.sock", "redis unix domain socket path");
+
+namespace
+{
+    folly::CPUThreadPoolExecutor& executor()
+    {
+        static folly::CPUThreadPoolExecutor exec(1);
+        return exec;
+    }
+
+    std::shared_ptr<redis::RedisClient> client(const std::string& host)
+    {
+        auto client = std::make_shared<redis::RedisClient>(&executor());
+        //结果在IO线程完成, 只比较传输本身的延迟
+        client->SetInlineCompletion(true);
+        client->Connect(host, FLAGS_port).get();
+        client->Cmd().Set("bench:uds", "value").Query().get();
+        return client;
+    }
+    //每种地址的客户端只建立一次
+    std::shared_ptr<redis::RedisClient> tcpClient()
+    {
+        static auto c = client(FLAGS_host);
+        return c;
+    }
+    std::shared_ptr<redis::RedisClient> udsClient()
+    {
+        static auto c = client(FLAGS_unixsocket);
+        return c;
+    }
+
+    //一个接一个的GET, 每次等回包再发下一个
+    void roundTrips(unsigned n, const std::shared_ptr<redis::RedisClient>& c)
+    {
+        for (unsigned i = 0; i < n; i++) {
+            auto rpl = c->Cmd().Get("bench:uds").Query().get();
+            folly::doNotOptimizeAway(rpl);
+        }
+    }
+}
+
+//每个iteration是一次往返
+BENCHMARK(loopbackTcp, n)
+{
+    std::shared_ptr<redis::RedisClient> c;
+    BENCHMARK_SUSPEND { c = tcpClient(); }
+    roundTrips(n, c);
+}
+BENCHMARK_RELATIVE(unixSocket, n)
+{
+    std::shared_ptr<redis::RedisClient> c;
+    BENCHMARK_SUSPEND { c = udsClient(); }
+    roundTrips(n, c);
+}
+
+int main(int argc, char** argv)
+{
+    folly::Init init(&argc, &argv);
+    folly::runBenchmarks();
+    return 0;
+}
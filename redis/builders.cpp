@@ -1,179 +1,470 @@
 #include "redis/builders.h"
 
+#include <algorithm>
 #include <stdexcept>
 
 #include <folly/Conv.h>
-#include <folly/String.h>
 #include <folly/io/Cursor.h>
 
 #include "redis/util.h"
 namespace redis{
-    bool SimpleStringBuilder::Check()
-    {
-        if ( ready_ )return true;
-        if(buf_.empty())return false;
-        folly::io::Cursor cur(buf_.front());
-        auto idx = -1;
-        for(auto i=0; i < buf_.chainLength();i++){
-            auto c = cur.read<char>();
-            if(c=='\r' && *cur.peekBytes().data()=='\n'){
-                idx=i;
-                break;
+    namespace
+    {
+        //数组预分配上限, 防止异常的长度导致一次分配过大
+        constexpr int64_t MAX_ARRAY_RESERVE = 1 << 16;
+
+        Reply::Type aggregateType( char type )
+        {
+            switch ( type )
+            {
+            case '%':
+                return Reply::Type::Map;
+            case '~':
+                return Reply::Type::Set;
+            case '>':
+                return Reply::Type::Push;
+            default:
+                return Reply::Type::Array;
             }
         }
-        if(idx > 0){
-            auto r = buf_.split(idx)->moveToFbString();
-            buf_.trimStart(2);
-            rpl_.set( r.toStdString(), Reply::StringType::SimpleString);
-            ready_ = true;
-            return true;
+
+        Reply::StringType errorType( folly::StringPiece line )
+        {
+            auto str = std::string_view( line.data(), line.size() );
+            if ( util::StartsWith( str, "ASK" ) ) {
+                return Reply::StringType::AskError;
+            }
+            if ( util::StartsWith( str, "MOVED" ) ) {
+                return Reply::StringType::MovedError;
+            }
+            return Reply::StringType::Error;
         }
-        return false;
-    }
 
-    bool ErrorBuilder::Check()
-    {
-        ssbuilder_.Check();
-        if ( ssbuilder_.IsReady() )
+        Reply::StringType errorType( folly::IOBuf& line )
         {
-            ready_ = ssbuilder_.IsReady();
-            auto str =ssbuilder_.Build().AsString();
-            auto type = Reply::StringType::Error;
-             if(util::StartsWith(str,"ASK")){
-                type =Reply::StringType::AskError;
-             }else if(util::StartsWith(str,"MOVED")){
-                 type =Reply::StringType::MovedError;
-             }
-            rpl_.set(std::move(str), type );
-            return true;
+            line.coalesce();
+            return errorType( folly::StringPiece( reinterpret_cast<const char*>( line.data() ), line.length() ) );
         }
-        return false;
     }
-    bool BulkStringBuilder::fetchSize()
+
+    bool ReplyBuilder::findLine( char& type, std::size_t& len )
     {
-        if ( intBuilder_.IsReady() )return true;
-        intBuilder_.Check();
-        if ( !intBuilder_.IsReady() )return false;
-        size_ = intBuilder_.Integer();
-        if ( size_ == 0 || size_ == -1 ) {
-            rpl_.set();
-            ready_ = true;
-        }
+        const auto idx = scanner_.Find( buffer_ );
+        if ( idx < 0 )return false;
+        if ( idx == 0 )throw std::runtime_error( "missing reply type" );
+        folly::io::Cursor cur( buffer_.front() );
+        type = cur.read<char>();
+        len = static_cast<std::size_t>( idx - 1 );
         return true;
     }
-    bool BulkStringBuilder::Check() {
-        do
-        {
-            if ( ready_ ) break;
-            if ( !fetchSize() || ready_ )break;
-            fetchStr();
-        } while ( false );
-        return ready_;
+
+    std::unique_ptr<folly::IOBuf> ReplyBuilder::takeLine( std::size_t len )
+    {
+        buffer_.trimStart( 1 );
+        auto line = buffer_.split( len );
+        buffer_.trimStart( 2 );
+        scanner_.Reset();
+        return line;
     }
 
-    bool BulkStringBuilder::fetchStr()
+    int64_t ReplyBuilder::takeInteger( std::size_t len )
     {
-        if(buf_.chainLength() < ( static_cast<std::size_t>( size_ ) + 2 ) ){
-            return false;
+        const auto val = ParseInteger( buffer_, 1, len );
+        buffer_.trimStart( len + 3 );
+        scanner_.Reset();
+        return val;
+    }
+
+    void ReplyBuilder::takeString( Reply& rpl, std::size_t len, Reply::StringType kind )
+    {
+        if ( inArena() && len <= kArenaStringMax ) {
+            setArenaString( rpl, peek( 1, len ), kind );
+            skipLine( len );
+            return;
         }
-        folly::io::Cursor cur(buf_.front());
-        cur.skip(size_);
-        auto c = cur.read<char>();
-        auto c1 = cur.read<char>();
-        if ( c != '\r' || c1 !='\n') {
-            throw std::runtime_error( "wrong ending sequence" );
+        if ( len < kMinSliceSize ) {
+            //+OK这类短行拷贝出来, 不超过15字节时在std::string的SSO里, 不分配
+            const auto str = peek( 1, len );
+            rpl.set( str.str(), kind == Reply::StringType::Error ? errorType( str ) : kind );
+            skipLine( len );
+            return;
         }
-        auto r = buf_.split(size_)->moveToFbString();
-        rpl_.set( r.toStdString(), Reply::StringType::BulkString);
-        buf_.trimStart(2);
-        ready_ = true;
-        return true;
+        auto line = takeLine( len );
+        if ( kind == Reply::StringType::Error )kind = errorType( *line );
+        rpl.set( std::move( line ), kind );
     }
 
-    bool IntBuilder::Check() {
-        if ( ready_ )return true;
-        if(buf_.empty())return false;
-        folly::io::Cursor cur(buf_.front());
-        auto idx = -1;
-        for(auto i=0; i < buf_.chainLength();i++){
-            auto c = cur.read<char>();
-            if(c=='\r' && *cur.peekBytes().data()=='\n'){
-                idx=i;
-                break;
-            }
+    void ReplyBuilder::setArenaString( Reply& rpl, folly::StringPiece str, Reply::StringType kind )
+    {
+        const auto view = arena_->Copy( str );
+        if ( kind == Reply::StringType::Error )kind = errorType( view );
+        rpl.setView( view, kind );
+    }
+
+    void ReplyBuilder::skipLine( std::size_t len )
+    {
+        buffer_.trimStart( len + 3 );
+        scanner_.Reset();
+    }
+
+    folly::StringPiece ReplyBuilder::peek( std::size_t offset, std::size_t len )
+    {
+        const auto* head = buffer_.front();
+        if ( head && offset + len <= head->length() ) {
+            return { reinterpret_cast<const char*>( head->data() ) + offset, len };
         }
-        if(idx > 0){
-            auto r = buf_.split(idx)->moveToFbString();
-            buf_.trimStart(2);
-            val_ = folly::to<int64_t>( r );
-            rpl_.set( val_ );
-            ready_ = true;
-            return true;
+        scratch_.resize( len );
+        folly::io::Cursor cur( head );
+        cur.skip( offset );
+        cur.pull( &scratch_[0], len );
+        return scratch_;
+    }
+
+    void ReplyBuilder::expectCRLF( std::size_t offset )
+    {
+        folly::io::Cursor cur( buffer_.front() );
+        cur.skip( offset );
+        auto c = cur.read<char>();
+        auto c1 = cur.read<char>();
+        if ( c != '\r' || c1 != '\n' ) {
+            throw std::runtime_error( "wrong ending sequence" );
         }
-        return false;
     }
 
-    bool ArrayBuilder::Check()
+    bool ReplyBuilder::streamBulk( Reply& rpl )
     {
-        do
+        //有多少交多少, 读缓冲里不保留payload
+        while ( bulk_size_ > 0 && !buffer_.empty() )
         {
-            if(buf_.empty())break;
-            if ( ready_ )break;
-            if ( !fetchSize() )break;
-            while (!ready_ )
-            {
-                if ( !fetchField() )break;
-            }
-        } while ( false );
-        return ready_;
+            const auto n = std::min( static_cast<std::size_t>( bulk_size_ ), buffer_.chainLength() );
+            chunk_cb_( buffer_.split( n ) );
+            bulk_size_ -= static_cast<int64_t>( n );
+        }
+        if ( bulk_size_ > 0 || buffer_.chainLength() < 2 )return false;
+        expectCRLF( 0 );
+        buffer_.trimStart( 2 );
+        rpl.set( std::string(), Reply::StringType::BulkString );
+        bulk_size_ = -1;
+        return true;
     }
 
-    bool ArrayBuilder::fetchSize()
+    bool ReplyBuilder::readBulk( Reply& rpl )
     {
-        if ( intBuilder_.IsReady() )return true;
-        intBuilder_.Check();
-        if ( !intBuilder_.IsReady() )return false;
-        size_ = intBuilder_.Integer();
-        if ( size_ == 0ul ) {
-            rpl_.set();
-            ready_ = true;
+        if ( chunk_cb_ && depth_ == 0 && bulk_type_ == '$' )return streamBulk( rpl );
+        auto size = static_cast<std::size_t>( bulk_size_ );
+        if ( buffer_.chainLength() < size + 2 )return false;
+        expectCRLF( size );
+        auto kind = Reply::StringType::BulkString;
+        if ( bulk_type_ == '=' ) {
+            //verbatim string前4个字节是格式, 如"txt:"
+            if ( size < 4 )throw std::runtime_error( "invalid verbatim string" );
+            buffer_.trimStart( 4 );
+            size -= 4;
+            kind = Reply::StringType::Verbatim;
+        } else if ( bulk_type_ == '!' ) {
+            //blob error, 空的也是错误
+            kind = Reply::StringType::Error;
+        }
+        if ( size == 0 ) {
+            rpl.set( std::string(), kind );
+        } else if ( inArena() && size <= kArenaStringMax ) {
+            //错误的具体类型在setArenaString里区分
+            setArenaString( rpl, peek( 0, size ), kind );
+            buffer_.trimStart( size );
+        } else if ( size < kMinSliceSize ) {
+            const auto str = peek( 0, size );
+            if ( kind == Reply::StringType::Error )kind = errorType( str );
+            rpl.set( str.str(), kind );
+            buffer_.trimStart( size );
+        } else {
+            //payload直接引用读缓冲, 不拷贝出来
+            auto payload = buffer_.split( size );
+            if ( kind == Reply::StringType::Error )kind = errorType( *payload );
+            rpl.set( std::move( payload ), kind );
         }
+        buffer_.trimStart( 2 );
+        bulk_size_ = -1;
         return true;
     }
-    std::unique_ptr<Builder> CreateBuilder( unsigned char id,folly::IOBufQueue& buf );
 
-    bool ArrayBuilder::fetchField()
+    bool ReplyBuilder::pushFrame( char type, int64_t size )
     {
-        if(buf_.empty())return false;
-        if ( !curbuilder_ ) {
-            auto id =*buf_.front()->data();
-            curbuilder_ = CreateBuilder( id,buf_ );
-            buf_.trimStart(1);
+        //map和attribute的每一项是key,value两个值
+        if ( type == '%' || type == '|' )size *= 2;
+        if ( type != '|' ) {
+            if ( auto v = visitor() ) {
+                v->onArrayBegin( size, aggregateType( type ) );
+                if ( size == 0 )v->onArrayEnd();
+            }
+        }
+        if ( size == 0 )return false;
+        if ( depth_ == kMaxDepth ) {
+            throw std::runtime_error( "reply nesting too deep" );
+        }
+        const auto reserve = static_cast<std::size_t>( std::min( size, MAX_ARRAY_RESERVE ) );
+        //每个顶层的聚合类型一个arena, 第一块缓冲按顶层元素个数估计
+        if ( depth_ == 0 ) {
+            arena_.reset( arena_mode_ && !visiting_ && type != '|' ? ReplyArena::Create( reserve * sizeof( Reply ) * 2 ) : nullptr );
+        }
+        auto& frame = stack_[depth_++];
+        frame.type = type;
+        frame.size = size;
+        frame.count = 0;
+        if ( visiting_ ) {
+            if ( type == '|' )++attrs_;
+        } else if ( arena_ ) {
+            frame.arena_elems.emplace( arena_->Resource() );
+            frame.arena_elems->reserve( reserve );
+        } else {
+            frame.elems.emplace();
+            frame.elems->reserve( reserve );
         }
-        curbuilder_->Check();
-        if ( !curbuilder_->IsReady() )
-            return false;
-        rpl_ << curbuilder_->Build();
-        curbuilder_.reset();
-        if ( rpl_.AsArray().size() == size_ )ready_ = true;
         return true;
     }
-    std::unique_ptr<Builder> CreateBuilder( unsigned char id,folly::IOBufQueue& buf )
+
+    bool ReplyBuilder::visitLine( char type, std::size_t len )
     {
-        switch ( id )
+        auto* v = visitor();
+        switch ( type )
         {
         case '+':
-            return std::make_unique<SimpleStringBuilder>(buf);
+        case '(':
+            if ( v )v->onSimple( peek( 1, len ) );
+            skipLine( len );
+            return true;
         case '-':
-            return std::make_unique<ErrorBuilder>(buf);
+            if ( v )v->onError( peek( 1, len ) );
+            skipLine( len );
+            return true;
         case ':':
-            return std::make_unique<IntBuilder>(buf);
+        {
+            const auto val = takeInteger( len );
+            if ( v )v->onInt( val );
+            return true;
+        }
+        case '_':
+            skipLine( len );
+            if ( v )v->onNull();
+            return true;
+        case ',':
+        {
+            const auto val = folly::to<double>( peek( 1, len ) );
+            skipLine( len );
+            if ( v )v->onDouble( val );
+            return true;
+        }
+        case '#':
+        {
+            const auto str = peek( 1, len );
+            if ( str != "t" && str != "f" )throw std::runtime_error( "invalid boolean reply" );
+            const bool val = str == "t";
+            skipLine( len );
+            if ( v )v->onBool( val );
+            return true;
+        }
         case '$':
-            return std::make_unique<BulkStringBuilder>(buf);
+        case '=':
+        case '!':
+        {
+            const auto size = takeInteger( len );
+            if ( size >= 0 ) {
+                bulk_size_ = size;
+                bulk_type_ = type;
+                return false;
+            }
+            if ( v )v->onNull();
+            return true;
+        }
         case '*':
-            return std::make_unique<ArrayBuilder>(buf);
+        case '%':
+        case '~':
+        case '>':
+        case '|':
+        {
+            const auto size = takeInteger( len );
+            if ( size < 0 ) {
+                if ( v )v->onNull();
+                return true;
+            }
+            //空的聚合类型在pushFrame里已经回调了begin/end
+            return !( pushFrame( type, size ) || type == '|' );
+        }
         default:
-            return nullptr;
+            throw std::runtime_error( folly::to<std::string>( "unknown reply type: ", static_cast<int>( type ) ) );
+        }
+    }
+
+    bool ReplyBuilder::visitBulk()
+    {
+        const auto size = static_cast<std::size_t>( bulk_size_ );
+        if ( buffer_.chainLength() < size + 2 )return false;
+        expectCRLF( size );
+        if ( auto v = visitor() ) {
+            if ( bulk_type_ == '=' ) {
+                if ( size < 4 )throw std::runtime_error( "invalid verbatim string" );
+                v->onBulk( peek( 4, size - 4 ) );
+            } else if ( bulk_type_ == '!' ) {
+                v->onError( peek( 0, size ) );
+            } else {
+                v->onBulk( peek( 0, size ) );
+            }
+        }
+        buffer_.trimStart( size + 2 );
+        bulk_size_ = -1;
+        return true;
+    }
+
+    bool ReplyBuilder::advance()
+    {
+        while ( depth_ > 0 )
+        {
+            auto& top = stack_[depth_ - 1];
+            if ( ++top.count < top.size )return false;
+            --depth_;
+            if ( top.type == '|' ) {
+                --attrs_;
+                return false;
+            }
+            if ( auto v = visitor() )v->onArrayEnd();
+        }
+        //数据已经交给visitor, 放一个占位的reply
+        valid_replies_.emplace_back();
+        return true;
+    }
+
+    bool ReplyBuilder::complete( Reply&& rpl )
+    {
+        while ( depth_ > 0 )
+        {
+            auto& top = stack_[depth_ - 1];
+            std::size_t count = 0;
+            if ( top.arena_elems ) {
+                top.arena_elems->push_back( std::move( rpl ) );
+                count = top.arena_elems->size();
+            } else {
+                top.elems->push_back( std::move( rpl ) );
+                count = top.elems->size();
+            }
+            if ( static_cast<int64_t>( count ) < top.size )return false;
+            --depth_;
+            if ( top.type == '|' ) {
+                //attribute只是后面那个值的附加信息, 丢弃后继续解析那个值
+                top.elems.reset();
+                top.arena_elems.reset();
+                return false;
+            }
+            if ( !top.arena_elems ) {
+                rpl = Reply( std::move( *top.elems ), aggregateType( top.type ) );
+            } else if ( depth_ == 0 ) {
+                //根节点接管arena
+                rpl = Reply( std::move( arena_ ), std::move( *top.arena_elems ), aggregateType( top.type ) );
+            } else {
+                rpl = Reply( std::move( *top.arena_elems ), aggregateType( top.type ) );
+            }
+            top.elems.reset();
+            top.arena_elems.reset();
+        }
+        valid_replies_.push_back( std::move( rpl ) );
+        return true;
+    }
+
+    void ReplyBuilder::Detach()
+    {
+        visitor_ = nullptr;
+        if ( chunk_cb_ && depth_ == 0 && bulk_size_ >= 0 ) {
+            //流式读了一半的bulk string, 剩下的payload直接丢弃, 不再缓存到读缓冲
+            chunk_cb_ = []( std::unique_ptr<folly::IOBuf> ) {};
+        } else {
+            chunk_cb_ = nullptr;
+        }
+    }
+
+    bool ReplyBuilder::Build()
+    {
+        Reply rpl;
+        while ( true )
+        {
+            if ( bulk_size_ >= 0 ) {
+                if ( visiting_ && !( depth_ == 0 && bulk_type_ == '!' ) ) {
+                    if ( !visitBulk() )return false;
+                    if ( advance() )return true;
+                    continue;
+                }
+                if ( !readBulk( rpl ) )return false;
+                if ( complete( std::move( rpl ) ) )return true;
+                continue;
+            }
+            char type = 0;
+            std::size_t len = 0;
+            if ( !findLine( type, len ) )return false;
+            //顶层的错误和push不交给visitor: 错误要用来处理重定向, push不属于当前命令
+            if ( depth_ == 0 )visiting_ = visitor_ && type != '-' && type != '>';
+            if ( visiting_ ) {
+                if ( visitLine( type, len ) && advance() )return true;
+                continue;
+            }
+            switch ( type )
+            {
+            case '+':
+                takeString( rpl, len, Reply::StringType::SimpleString );
+                break;
+            case '-':
+                takeString( rpl, len, Reply::StringType::Error );
+                break;
+            case '(':
+                takeString( rpl, len, Reply::StringType::BigNumber );
+                break;
+            case ':':
+                rpl.set( takeInteger( len ) );
+                break;
+            case '_':
+                skipLine( len );
+                rpl.set();
+                break;
+            case ',':
+                rpl.setDouble( folly::to<double>( peek( 1, len ) ) );
+                skipLine( len );
+                break;
+            case '#':
+            {
+                const auto str = peek( 1, len );
+                if ( str != "t" && str != "f" )throw std::runtime_error( "invalid boolean reply" );
+                rpl.setBool( str == "t" );
+                skipLine( len );
+                break;
+            }
+            case '$':
+            case '=':
+            case '!':
+            {
+                const auto size = takeInteger( len );
+                if ( size < 0 ) {
+                    rpl.set();
+                    break;
+                }
+                bulk_size_ = size;
+                bulk_type_ = type;
+                continue;
+            }
+            case '*':
+            case '%':
+            case '~':
+            case '>':
+            case '|':
+            {
+                const auto size = takeInteger( len );
+                if ( size < 0 ) {
+                    rpl.set();
+                    break;
+                }
+                if ( pushFrame( type, size ) || type == '|' )continue;
+                rpl = Reply( Reply::Array(), aggregateType( type ) );
+                break;
+            }
+            default:
+                throw std::runtime_error( folly::to<std::string>( "unknown reply type: ", static_cast<int>( type ) ) );
+            }
+            if ( complete( std::move( rpl ) ) )return true;
         }
     }
 
@@ -200,32 +491,37 @@ namespace redis{
         valid_replies_.pop_front();
     }
 
-    bool ReplyBuilder::IsReplyAvailable() const
+    Reply ReplyBuilder::TakeFront()
     {
-        return !valid_replies_.empty();
+        if ( !IsReplyAvailable() )
+        {
+            throw std::runtime_error( "no reply" );
+        }
+        Reply rpl = std::move( valid_replies_.front() );
+        valid_replies_.pop_front();
+        return rpl;
     }
 
-    void ReplyBuilder::Reset()
+    bool ReplyBuilder::IsReplyAvailable() const
     {
-        builder_.reset();
-        buffer_.clear();
+        return !valid_replies_.empty();
     }
 
-    bool ReplyBuilder::Build()
+    void ReplyBuilder::Reset()
     {
-        if ( buffer_.empty() )return false;
-
-        if ( !builder_ ) {
-            auto id =*buffer_.front()->data();
-            builder_ = CreateBuilder( id,buffer_ );
-            buffer_.trimStart( 1);
-        }
-        builder_->Check();
-        if ( builder_->IsReady() ) {
-            valid_replies_.push_back( builder_->Build() );
-            builder_.reset();
-            return true;
+        for ( std::size_t i = 0; i < depth_; i++ ) {
+            stack_[i].elems.reset();
+            stack_[i].arena_elems.reset();
         }
-        return false;
+        depth_ = 0;
+        arena_.reset();
+        bulk_size_ = -1;
+        bulk_type_ = '$';
+        attrs_ = 0;
+        chunk_cb_ = nullptr;
+        visitor_ = nullptr;
+        visiting_ = false;
+        scanner_.Reset();
+        buffer_.clear();
     }
-}
\ No newline at end of file
+}
@@ -1,95 +1,177 @@
 #pragma once
+#include <array>
 #include <deque>
+#include <functional>
 #include <memory>
+#include <optional>
+#include <string>
+#include <vector>
 
+#include <folly/Conv.h>
+#include <folly/Range.h>
 #include <folly/io/IOBufQueue.h>
 
+#include "redis/line_scanner.h"
 #include "redis/reply.h"
 namespace redis {
-        class Builder
+        //流式读取bulk string时, 每收到一段数据回调一次
+        using ChunkCallback = std::function<void( std::unique_ptr<folly::IOBuf> )>;
+
+        /**
+         * SAX风格的解析回调, 设置后reply不再构造成Reply树, 数据直接交给visitor
+         * 字符串参数指向读缓冲, 只在回调期间有效; 回调不能抛异常
+         * 顶层的错误和RESP3 push仍然构造成Reply返回, 错误用来处理集群重定向
+         */
+        class ReplyVisitor
         {
         public:
-            explicit Builder(folly::IOBufQueue& buf):buf_(buf){};
-            virtual ~Builder() = default;
-            virtual bool Check() = 0;
-            virtual bool IsReady() {
-                return ready_;
+            virtual ~ReplyVisitor() = default;
+            //Array/Map/Set/Push开始, n是元素个数(map是key和value的总数)
+            virtual void onArrayBegin( int64_t n, Reply::Type type ) = 0;
+            virtual void onArrayEnd() = 0;
+            //bulk string, verbatim string
+            virtual void onBulk( folly::StringPiece str ) = 0;
+            //simple string, big number
+            virtual void onSimple( folly::StringPiece str ) {
+                onBulk( str );
             }
-            virtual Reply Build() {
-                return std::move( rpl_ );
+            virtual void onInt( int64_t val ) = 0;
+            virtual void onDouble( double val ) {
+                onBulk( folly::to<std::string>( val ) );
             }
-        protected:
-            bool ready_{false};
-            folly::IOBufQueue& buf_;
-            Reply rpl_;
-        };
-
-        class SimpleStringBuilder: public Builder
-        {
-        public:
-            explicit SimpleStringBuilder(folly::IOBufQueue& buf):Builder(buf){};
-            bool Check() override;
-        };
-        class ErrorBuilder : public Builder
-        {
-        public:
-            explicit ErrorBuilder(folly::IOBufQueue& buf):Builder(buf), ssbuilder_(buf){};
-            bool Check() override;
-        private:
-            SimpleStringBuilder ssbuilder_;
-        };
-
-        class IntBuilder : public Builder {
-        public:
-            explicit IntBuilder(folly::IOBufQueue& buf):Builder(buf){};
-            bool Check() override;
-            int64_t Integer()const {
-                return val_;
+            virtual void onBool( bool val ) {
+                onInt( val ? 1 : 0 );
             }
-        private:
-            int64_t val_;
-        };
-
-        class BulkStringBuilder : public Builder {
-        public:
-            explicit BulkStringBuilder(folly::IOBufQueue& buf):Builder(buf), intBuilder_(buf){};
-            bool Check() override;
-        private:
-            bool fetchSize();
-            bool fetchStr();
-        private:
-            IntBuilder intBuilder_;
-            int64_t size_{0};
-        };
-        class ArrayBuilder : public Builder {
-        public:
-            explicit ArrayBuilder(folly::IOBufQueue& buf):Builder(buf), intBuilder_(buf){};
-            bool Check() override;
-        private:
-            bool fetchSize();
-            bool fetchField();
-        private:
-            IntBuilder intBuilder_;
-            int64_t size_{ 0 };
-            std::unique_ptr<Builder> curbuilder_;
+            virtual void onNull() = 0;
+            //数组中的错误
+            virtual void onError( folly::StringPiece err ) = 0;
         };
-
+        /**
+         * 非递归的RESP2/RESP3解析器
+         * 嵌套的数组用固定容量的帧栈保存, 数据不完整时保留状态, 下次数据到达后继续
+         * RESP3的attribute会被丢弃
+         */
         class ReplyBuilder {
         public:
+            //数组最大嵌套深度
+            static constexpr std::size_t kMaxDepth = 32;
+            //arena模式下不超过这个长度的字符串拷贝到arena, 更长的仍然引用读缓冲
+            static constexpr std::size_t kArenaStringMax = 1024;
+            //不短于这个长度的字符串才引用读缓冲; 更短的拷贝出来, 小切片会让整块读缓冲(最大256KB)跟着reply一起存活
+            static constexpr std::size_t kMinSliceSize = 16 * 1024;
             explicit ReplyBuilder(folly::IOBufQueue& buf):buffer_(buf){};
             //返回第一个
             void operator>>( Reply& rpl ) const;
             const Reply& GetFront() const;
             //删除第一个
             void PopFront();
+            //移出第一个
+            Reply TakeFront();
             //是否可用
             bool IsReplyAvailable()const;
             void Reset();
         public:
+            //解析出一个完整的reply返回true, 数据不够返回false, 协议错误抛异常
             bool Build();
+            //是否有解析了一半的reply
+            bool InProgress() const {
+                return depth_ > 0 || bulk_size_ >= 0;
+            }
+            /**
+             * 设置后, 下一个顶层的bulk string不再缓存, 数据一到就交给cb, 解析出的reply是空的bulk string
+             * 只能在InProgress()为false时修改; cb不能抛异常
+             */
+            void SetChunkCallback( ChunkCallback cb ) {
+                chunk_cb_ = std::move( cb );
+            }
+            /**
+             * 设置后, 下一个reply交给visitor, 解析出的reply是Null占位(顶层的错误和push除外)
+             * 只能在InProgress()为false时修改, 调用者保证visitor在reply解析完之前有效
+             */
+            void SetVisitor( ReplyVisitor* visitor ) {
+                visitor_ = visitor;
+            }
+            /**
+             * 去掉visitor和流式回调, 任何时候都可以调用(如命令已经超时)
+             * 解析了一半的reply不再回调, 剩下的数据照常解析后丢弃
+             */
+            void Detach();
+            /**
+             * arena模式: 顶层的聚合类型的所有节点从一个ReplyArena分配, 由解析出的reply持有,
+             * reply释放时整体释放, 适合XREAD/CLUSTER SLOTS/XINFO这类嵌套很深的回包
+             */
+            void SetArena( bool enable ) {
+                arena_mode_ = enable;
+            }
+        private:
+            struct Frame
+            {
+                //类型字节 * % ~ > |
+                char type{ '*' };
+                int64_t size{ 0 };
+                //visitor模式下只计数
+                int64_t count{ 0 };
+                std::optional<Reply::Array> elems;
+                //arena模式下的元素
+                std::optional<Reply::ArenaArray> arena_elems;
+            };
+            //查找一行, len是内容长度(不含类型字节和\r\n), 数据不够返回false
+            bool findLine( char& type, std::size_t& len );
+            //取出findLine找到的行, len不为0
+            std::unique_ptr<folly::IOBuf> takeLine( std::size_t len );
+            //直接在读缓冲中解析整数行
+            int64_t takeInteger( std::size_t len );
+            //取出findLine找到的字符串行
+            void takeString( Reply& rpl, std::size_t len, Reply::StringType kind );
+            //跳过findLine找到的行
+            void skipLine( std::size_t len );
+            //offset处必须是\r\n
+            void expectCRLF( std::size_t offset );
+            //读bulk string的内容
+            bool readBulk( Reply& rpl );
+            //流式读bulk string的内容
+            bool streamBulk( Reply& rpl );
+            //开始一个聚合类型, 空的返回false
+            bool pushFrame( char type, int64_t size );
+            //读缓冲中[offset, offset+len)的视图, 跨buffer时拷贝到scratch_
+            folly::StringPiece peek( std::size_t offset, std::size_t len );
+            //是否正在arena中构造
+            bool inArena() const {
+                return arena_ && depth_ > 0;
+            }
+            void setArenaString( Reply& rpl, folly::StringPiece str, Reply::StringType kind );
+            //visitor模式: 当前是否要回调(attribute里的数据不回调)
+            ReplyVisitor* visitor() const {
+                return visiting_ && attrs_ == 0 ? visitor_ : nullptr;
+            }
+            //visitor模式处理一行, 一个值结束返回true
+            bool visitLine( char type, std::size_t len );
+            //visitor模式读bulk string
+            bool visitBulk();
+            //visitor模式一个值结束; 整个reply完成返回true
+            bool advance();
+            //一个值解析完成, 挂到上一层数组; 整个reply完成返回true
+            bool complete( Reply&& rpl );
         private:
             folly::IOBufQueue& buffer_;
-            std::unique_ptr<Builder> builder_;
+            LineScanner scanner_;
             std::deque<Reply> valid_replies_;
+            bool arena_mode_{ false };
+            //正在构造的reply树的arena, 要比stack_中的元素后析构
+            Reply::Root arena_;
+            //正在解析的数组
+            std::array<Frame, kMaxDepth> stack_;
+            std::size_t depth_{ 0 };
+            //等待中的bulk string长度, -1表示没有
+            int64_t bulk_size_{ -1 };
+            //bulk string的类型字节 $ = !
+            char bulk_type_{ '$' };
+            ChunkCallback chunk_cb_;
+            ReplyVisitor* visitor_{ nullptr };
+            //当前reply是否交给visitor
+            bool visiting_{ false };
+            //visitor模式下打开的attribute个数
+            std::size_t attrs_{ 0 };
+            std::string scratch_;
         };
-}
\ No newline at end of file
+}
@@ -10,7 +10,12 @@ namespace redis
         if(!conn_){
             conn_  =std::make_shared<Conn>(Conn::SINGLE);
         }
-        return conn_->Connect(host, port,pass,dbindex, timeout_ms).via(exec_);
+        conn_->SetProtocol(protocol_);
+        conn_->SetReplyArena(reply_arena_);
+        conn_->SetAutoPipeline(auto_pipeline_);
+        conn_->SetLimits(limits_);
+        if(push_cb_)conn_->SetPushCallback(push_cb_);
+        return conn_->Connect(host, port,pass,dbindex, timeout_ms, conn_options_).via(exec_);
     }
     void RedisClient::Close() {
         if(conn_)conn_->Close();
@@ -20,12 +25,24 @@ namespace redis
     }
     folly::Future<Reply> RedisClient::Query(Command cmd)
     {
-        return conn_->Query(std::move(cmd)).via(exec_);
+        return complete(conn_->Query(std::move(cmd)));
+    }
+    folly::Future<Reply> RedisClient::QueryStream(Command cmd, ChunkCallback cb)
+    {
+        return complete(conn_->QueryStream(std::move(cmd), std::move(cb)));
     }
     void RedisClient::Run(Command cmd)
     {
         return conn_->Run(std::move(cmd));
     }
+    folly::Future<Reply> RedisClient::QueryPrepared(std::unique_ptr<folly::IOBuf> cmd, std::string_view)
+    {
+        return complete(conn_->QueryPrepared(std::move(cmd)));
+    }
+    void RedisClient::RunPrepared(std::unique_ptr<folly::IOBuf> cmd, std::string_view)
+    {
+        conn_->RunPrepared(std::move(cmd));
+    }
     void RedisSubscriber::Subscribe(const std::string& channel)const
     {
         auto buf = client_->Cmd().Cmd("SUBSCRIBE").Arg(channel).Build().Serialize();
@@ -111,21 +128,21 @@ namespace redis
     void RedisSubscriber::onReply(Reply&& rpl)const
     {
         auto conn = client_->Connection();
-        if(!rpl.IsArray())
+        if(!rpl.IsArray() && !rpl.IsPush())
         {
-            if (rpl.IsError() || rpl.IsString()) XLOG(ERR) << "RedisSubscriber[" << conn->Addr().getAddressStr() << "] received:" << rpl.AsString();
+            if (rpl.IsError() || rpl.IsString()) XLOG(ERR) << "RedisSubscriber[" << conn->Addr().describe() << "] received:" << rpl.AsString();
             return;
         }
         auto arr = rpl.AsArray();
         if(arr.empty())
         {
-            XLOG(ERR) << "RedisSubscriber[" << conn->Addr().getAddressStr() << "] received message error: array is empty";
+            XLOG(ERR) << "RedisSubscriber[" << conn->Addr().describe() << "] received message error: array is empty";
         }
         if(!callback_)
         {
             std::stringstream ss;
             ss << rpl;
-            XLOG(ERR)<<"RedisSubscriber[" << conn->Addr().getAddressStr() << "] received message:"<<ss.str();
+            XLOG(ERR)<<"RedisSubscriber[" << conn->Addr().describe() << "] received message:"<<ss.str();
             return;
         }
         switch (auto type = msgType(arr[0].AsString()))
@@ -136,7 +153,7 @@ namespace redis
             {
                 std::stringstream ss;
                 ss << rpl;
-                XLOG(ERR) << "RedisSubscriber[" << conn->Addr().getAddressStr() << "] received error message:" << ss.str();
+                XLOG(ERR) << "RedisSubscriber[" << conn->Addr().describe() << "] received error message:" << ss.str();
                 return;
             }
             folly::via(client_->GetExecutor(), [this,rpl{std::move(rpl)}]()
@@ -152,7 +169,7 @@ namespace redis
             {
                 std::stringstream ss;
                 ss << rpl;
-                XLOG(ERR) << "RedisSubscriber[" << conn->Addr().getAddressStr() << "] received error pmessage:" << ss.str();
+                XLOG(ERR) << "RedisSubscriber[" << conn->Addr().describe() << "] received error pmessage:" << ss.str();
                 return;
             }
             folly::via(client_->GetExecutor(), [this, rpl{ std::move(rpl) }]()
@@ -171,7 +188,7 @@ namespace redis
             {
                 std::stringstream ss;
                 ss << rpl;
-                XLOG(ERR) << "RedisSubscriber[" << conn->Addr().getAddressStr() << "] received error meta:" << ss.str();
+                XLOG(ERR) << "RedisSubscriber[" << conn->Addr().describe() << "] received error meta:" << ss.str();
                 return;
             }
             folly::via(client_->GetExecutor(), [this, rpl{ std::move(rpl) },type]()
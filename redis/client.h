@@ -17,6 +17,8 @@ namespace redis
         ~RedisClient()override{
             XLOG(DBG,"redis client release");
         }
+        using ClientInterface::Connect;
+        //host可以是unix domain socket的路径, 见Conn::Connect
         folly::Future<folly::Unit> Connect( const std::string& host, int port, const std::string& pass = "", int dbindex = 0, int32_t timeout_ms = 2000 )override;
         void Close() override;
         bool IsConnected()const;
@@ -30,14 +32,32 @@ namespace redis
             return shared();
         }
         std::shared_ptr<Conn> Connection()const { return conn_; }
+        //Connect之前调用, 3表示使用RESP3(需要redis 6.0以上)
+        void SetProtocol(int protover) { protocol_ = protover; }
+        //RESP3 push消息回调, 在IO线程执行
+        void SetPushCallback(Conn::ReplyCallback cb) { push_cb_ = std::move(cb); }
+        //Connect之前调用, 嵌套很深的回包(XREAD等)从arena分配, 释放时只有一次
+        void SetReplyArena(bool enable) { reply_arena_ = enable; }
+        //Connect之前调用, 并发提交的命令自动合并写出, 见Conn::SetAutoPipeline
+        void SetAutoPipeline(bool enable) { auto_pipeline_ = enable; }
+        //Connect之前调用, 每个连接的背压设置, 见Conn::SetLimits
+        void SetLimits(const ConnLimits& limits) { limits_ = limits; }
     protected:
         folly::Future<Reply> Query(Command cmd)override;
+        folly::Future<Reply> QueryStream(Command cmd, ChunkCallback cb)override;
         void Run(Command cmd)override;
+        folly::Future<Reply> QueryPrepared(std::unique_ptr<folly::IOBuf> cmd, std::string_view key)override;
+        void RunPrepared(std::unique_ptr<folly::IOBuf> cmd, std::string_view key)override;
     private:
         friend class Command;
         friend class RedisSubscriber;
         std::shared_ptr<Conn>  conn_;                  // redis连接
         Conn::ReplyCallback rpl_callback_{nullptr};
+        Conn::ReplyCallback push_cb_{nullptr};
+        int protocol_{2};
+        bool reply_arena_{false};
+        bool auto_pipeline_{false};
+        ConnLimits limits_;
     };
 
     class REDIS_EXPORT RedisSubscriber:public std::enable_shared_from_this<RedisSubscriber>
@@ -87,7 +107,7 @@ namespace redis
         }
         folly::Future<folly::Unit> Connect(const RedisConf& conf, int32_t timeout_ms = 2000)
         {
-            return Connect(conf.addr,conf.port,conf.auth,conf.db,timeout_ms);
+            return Connect(conf.Host(),conf.port,conf.auth,conf.db,timeout_ms);
         }
         void Close()
         {
@@ -1,9 +1,13 @@
 ﻿#pragma once
 #include <memory>
 #include <string>
+#include <string_view>
+
+#include <folly/executors/InlineExecutor.h>
 
 #include "redis/redis_export.h"
 #include "redis/command.h"
+#include "redis/conn.h"
 namespace redis
 {
     struct REDIS_EXPORT RedisConf
@@ -12,6 +16,9 @@ namespace redis
         int port{ 0 };
         std::string auth{};
         int db{ 0 };
+        std::string path{};     //unix domain socket路径, 不为空时忽略addr和port
+        //Connect用的host
+        const std::string& Host() const { return path.empty() ? addr : path; }
     };
     /**
      * 公共接口
@@ -25,10 +32,24 @@ namespace redis
         virtual folly::Future<folly::Unit> Connect(const std::string& host, int port, const std::string& pass = "", int dbindex = 0, int32_t timeout_ms = 2000)=0;
 
         folly::Future<folly::Unit> Connect(const RedisConf& conf, int32_t timeout_ms = 2000) {
-            return Connect(conf.addr, conf.port, conf.auth, conf.db, timeout_ms);
+            return Connect(conf.Host(), conf.port, conf.auth, conf.db, timeout_ms);
+        }
+        //带socket选项连接, 选项在重连时同样生效, 见ConnOptions
+        folly::Future<folly::Unit> Connect(const std::string& host, int port, const ConnOptions& options, const std::string& pass = "", int dbindex = 0, int32_t timeout_ms = 2000) {
+            conn_options_ = options;
+            return Connect(host, port, pass, dbindex, timeout_ms);
+        }
+        folly::Future<folly::Unit> Connect(const RedisConf& conf, const ConnOptions& options, int32_t timeout_ms = 2000) {
+            conn_options_ = options;
+            return Connect(conf, timeout_ms);
         }
         virtual void Close()=0;
         auto GetExecutor()const { return exec_; }
+        /**
+         * 查询结果直接在IO线程完成, 不再切换到exec_, 适合绑在IO线程上的低延迟处理
+         * 回调在IO线程执行, 不能阻塞
+         */
+        void SetInlineCompletion(bool enable) { inline_completion_ = enable; }
     public:
         Command Cmd(std::string cmd = "")
         {
@@ -41,9 +62,25 @@ namespace redis
         }
     protected:
         virtual folly::Future<Reply> Query(Command cmd)=0;
+        virtual folly::Future<Reply> QueryStream(Command cmd, ChunkCallback cb)=0;
         virtual void Run(Command cmd)=0;
+        //PreparedCommand绑定好的单条命令, 不构造Command; key只用来选连接, 调用期间有效
+        virtual folly::Future<Reply> QueryPrepared(std::unique_ptr<folly::IOBuf> cmd, std::string_view key)=0;
+        virtual void RunPrepared(std::unique_ptr<folly::IOBuf> cmd, std::string_view key)=0;
+        //按SetInlineCompletion选择结果的执行环境
+        template<class T>
+        folly::Future<T> complete(folly::SemiFuture<T>&& future) const
+        {
+            if (inline_completion_) {
+                return std::move(future).via(folly::getKeepAliveToken(folly::InlineExecutor::instance()));
+            }
+            return std::move(future).via(exec_);
+        }
     protected:
         friend class Command;
+        friend class PreparedCommand;
         folly::Executor::KeepAlive<folly::Executor> exec_;  // 默认回调执行环境
+        bool inline_completion_{ false };
+        ConnOptions conn_options_;
     };
 }
@@ -126,14 +126,15 @@ namespace redis
     }
 
     //连接到集群单个节点,然后更新整个集群
-    folly::SemiFuture<folly::Unit> ClusterConns::Connect(const std::string& host, int port, std::string pass /*= ""*/, int32_t timeout_ms)
+    folly::SemiFuture<folly::Unit> ClusterConns::Connect(const std::string& host, int port, std::string pass /*= ""*/, int32_t timeout_ms, const ConnOptions& options)
     {
         auto conn = std::make_shared<Conn>(shared_from_this());
         conns_.emplace(std::make_pair(Node{ host,port,false }, conn));
         shareds_.emplace(std::make_pair(Slot{ 0,SHARDS }, Node{ host,port,false }));
         pass_ = pass;
         timeout_ms_ = timeout_ms;
-        return conn->Connect(host, port,std::move(pass),0, timeout_ms).deferValue([shared=shared_from_this()](folly::Unit&&){
+        options_ = options;
+        return conn->Connect(host, port,std::move(pass),0, timeout_ms, options).deferValue([shared=shared_from_this()](folly::Unit&&){
             return shared->Update();
         });
     }
@@ -170,6 +171,13 @@ namespace redis
         return conn->Query(std::move(cmd));
     }
 
+    folly::SemiFuture<Reply> ClusterConns::QueryStream(int32_t slot,Command cmd,ChunkCallback cb)
+    {
+        const auto conn = GetConn(slot);
+        if (!conn)return folly::makeSemiFuture<Reply>(std::runtime_error(fmt::format("redis cluster no valid connection to slot {}", slot)));
+        return conn->QueryStream(std::move(cmd), std::move(cb));
+    }
+
     void ClusterConns::Run(int32_t slot,Command cmd)
     {
         const auto conn = GetConn(slot);
@@ -177,6 +185,20 @@ namespace redis
         conn->Run(std::move(cmd));
     }
 
+    folly::SemiFuture<Reply> ClusterConns::QueryPrepared(int32_t slot,std::unique_ptr<folly::IOBuf> cmd)
+    {
+        const auto conn = GetConn(slot);
+        if (!conn)return folly::makeSemiFuture<Reply>(std::runtime_error(fmt::format("redis cluster no valid connection to slot {}", slot)));
+        return conn->QueryPrepared(std::move(cmd));
+    }
+
+    void ClusterConns::RunPrepared(int32_t slot,std::unique_ptr<folly::IOBuf> cmd)
+    {
+        const auto conn = GetConn(slot);
+        if (!conn)return;
+        conn->RunPrepared(std::move(cmd));
+    }
+
     Node ParseNodeInfo(Reply&& rpl)
     {
         if (!rpl.IsArray())folly::throw_exception(std::invalid_argument("need a array reply"));
@@ -236,7 +258,7 @@ namespace redis
         for(auto& n:adds)
         {
             auto conn = std::make_shared<Conn>(shared_from_this());
-            futs.push_back(conn->Connect(n.host, n.port, pass_, 0, timeout_ms_));
+            futs.push_back(conn->Connect(n.host, n.port, pass_, 0, timeout_ms_, options_));
             conns_.emplace(std::make_pair(n, conn));
         }
         return folly::collectAll(futs).deferValue([](std::vector<folly::Try<folly::Unit>>&& results)
@@ -271,7 +293,7 @@ namespace redis
     folly::Future<folly::Unit> ClusterClient::Connect(const std::string& host, int port, const std::string& pass,int dbindex,
         int32_t timeout_ms)
     {
-        return conn_->Connect(host, port, pass,timeout_ms).via(exec_);
+        return conn_->Connect(host, port, pass,timeout_ms,conn_options_).via(exec_);
     }
 
     void ClusterClient::Close()
@@ -299,13 +321,28 @@ namespace redis
     folly::Future<Reply> ClusterClient::Query(Command cmd)
     {
         const auto slot = CheckCommandSlot(cmd);
-        return conn_->Query(slot,std::move(cmd)).via(exec_);
+        return complete(conn_->Query(slot,std::move(cmd)));
+    }
+    folly::Future<Reply> ClusterClient::QueryStream(Command cmd, ChunkCallback cb)
+    {
+        const auto slot = CheckCommandSlot(cmd);
+        return complete(conn_->QueryStream(slot,std::move(cmd),std::move(cb)));
     }
     void ClusterClient::Run(Command cmd)
     {
         const auto slot = CheckCommandSlot(cmd);
         conn_->Run(slot, std::move(cmd));
     }
+    folly::Future<Reply> ClusterClient::QueryPrepared(std::unique_ptr<folly::IOBuf> cmd, std::string_view key)
+    {
+        const int32_t slot = key.empty() ? folly::Random::rand32(0, SHARDS+1) : CalsSlot(key);
+        return complete(conn_->QueryPrepared(slot, std::move(cmd)));
+    }
+    void ClusterClient::RunPrepared(std::unique_ptr<folly::IOBuf> cmd, std::string_view key)
+    {
+        const int32_t slot = key.empty() ? folly::Random::rand32(0, SHARDS+1) : CalsSlot(key);
+        conn_->RunPrepared(slot, std::move(cmd));
+    }
 }
 
 namespace std
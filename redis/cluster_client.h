@@ -64,14 +64,17 @@ namespace redis
         using Conns = std::unordered_map<Node, std::shared_ptr<Conn>>;
     public:
         // 需要连接到所有的节点(包含主节点)
-        folly::SemiFuture<folly::Unit> Connect(const std::string& host, int port,std::string pass="", int32_t timeout_ms = 0);
+        folly::SemiFuture<folly::Unit> Connect(const std::string& host, int port,std::string pass="", int32_t timeout_ms = 0, const ConnOptions& options = ConnOptions());
         // 关闭所有连接
         void Close();
         //更新整个集群信息
         folly::SemiFuture<folly::Unit> Update();
     public:
         folly::SemiFuture<Reply> Query(int32_t slot,Command cmd);
+        folly::SemiFuture<Reply> QueryStream(int32_t slot,Command cmd,ChunkCallback cb);
         void Run(int32_t slot,Command cmd);
+        folly::SemiFuture<Reply> QueryPrepared(int32_t slot,std::unique_ptr<folly::IOBuf> cmd);
+        void RunPrepared(int32_t slot,std::unique_ptr<folly::IOBuf> cmd);
     public:
         void SetConnectCallback(const Conn::ConnectCallback& cb) {
             connect_cb_ = cb;
@@ -109,6 +112,7 @@ namespace redis
         //
         std::string pass_;
         int32_t timeout_ms_;
+        ConnOptions options_;
     };
 
     class ClusterClient:public ClientInterface
@@ -118,6 +122,7 @@ namespace redis
         ~ClusterClient()override {
             XLOG(DBG,"ClusterClient release");
         }
+        using ClientInterface::Connect;
         folly::Future<folly::Unit> Connect(const std::string& host, int port, const std::string& pass = "", int dbindex = 0, int32_t timeout_ms = 2000)override;
         void Close() override;
     public:
@@ -131,7 +136,10 @@ namespace redis
         }
     protected:
         folly::Future<Reply> Query(Command cmd)override;
+        folly::Future<Reply> QueryStream(Command cmd, ChunkCallback cb)override;
         void Run(Command cmd)override;
+        folly::Future<Reply> QueryPrepared(std::unique_ptr<folly::IOBuf> cmd, std::string_view key)override;
+        void RunPrepared(std::unique_ptr<folly::IOBuf> cmd, std::string_view key)override;
 
     private:
         std::shared_ptr<ClusterConns>  conn_;
@@ -54,8 +54,9 @@ namespace redis{
     }
     void Command::SerializeTo(folly::IOBufQueue& buf)const
     {
+        //小命令拷贝进前一个buffer的尾部, 大的直接引用
         for (auto& cmd : cmds_) {
-            buf.append(cmd.cmd.data(), cmd.cmd.size());
+            buf.append(*cmd.cmd, true);
         }
     }
     folly::Future<Reply> Command::Query(){
@@ -63,6 +64,20 @@ namespace redis{
         if(client_)return client_->Query(std::move(*this));
         return folly::makeFuture<Reply>(std::runtime_error("need a valid redis client"));
     }
+    folly::Future<Reply> Command::QueryStream(ChunkCallback cb){
+        buildCommand();
+        if(client_)return client_->QueryStream(std::move(*this), std::move(cb));
+        return folly::makeFuture<Reply>(std::runtime_error("need a valid redis client"));
+    }
+    folly::Future<folly::Unit> Command::Query(std::shared_ptr<ReplyVisitor> visitor){
+        if(!visitor)return folly::makeFuture<folly::Unit>(std::invalid_argument("need a valid visitor"));
+        visitor_ = std::move(visitor);
+        return Query().thenValue([](Reply&& rpl){
+            if(rpl.IsError() || rpl.IsMovedError() || rpl.IsAskError()){
+                throw std::runtime_error(rpl.AsString());
+            }
+        });
+    }
     void Command::Run()
     {
         buildCommand();
@@ -1,28 +1,59 @@
 #pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <map>
+#include <memory>
 #include <optional>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
+#include <folly/Conv.h>
+#include <folly/small_vector.h>
 #include <folly/lang/SafeAssert.h>
 #include <folly/futures/Future.h>
 #include <folly/io/IOBufQueue.h>
 #include <folly/logging/xlog.h>
 
+#include "redis/builders.h"
+#include "redis/command_prefix.h"
+#include "redis/decoder.h"
 #include "redis/reply.h"
 namespace redis{
     class ClientInterface;
 
     struct CommandVal{
-        std::string cmd{};
+        std::unique_ptr<folly::IOBuf> cmd{}; //序列化好的RESP, 发送时clone, 不拷贝数据
         std::string key{}; //对应的key值(clsuter中需要用来计算hash)
         bool ignore{ false };
+        //key是第几个参数(命令名是0), -1表示key不是用Key()加的参数
+        int32_t key_arg{ -1 };
         std::optional<Reply> rpl{};
-        CommandVal(std::string _cmd,std::string _key,bool _ignore)
-        :cmd(std::move(_cmd)), key(std::move(_key)), ignore(_ignore)
+        CommandVal(std::unique_ptr<folly::IOBuf> _cmd,std::string _key,bool _ignore,int32_t _key_arg = -1)
+        :cmd(std::move(_cmd)), key(std::move(_key)), ignore(_ignore), key_arg(_key_arg)
         {}
+        //命令文本, 只用于日志
+        std::string ToString()const{
+            std::string str;
+            if(!cmd)return str;
+            for (auto range : *cmd) {
+                str.append(reinterpret_cast<const char*>(range.data()), range.size());
+            }
+            return str;
+        }
     };
+    //大部分请求只有一条命令, 不用分配
+    using CommandList = folly::small_vector<CommandVal, 1>;
+    //需要先用folly::to转成字符串的参数类型
+    template<class T>
+    constexpr bool NeedConvertArg = !std::is_same_v<std::decay_t<T>, std::string>
+        && !std::is_same_v<std::decay_t<T>, std::string_view>
+        && !std::is_same_v<std::decay_t<T>, std::unique_ptr<folly::IOBuf>>
+        && !std::is_convertible_v<T, const char*>;
+
     class Command{
     public:
         using Self = Command;
@@ -39,31 +70,45 @@ namespace redis{
         Command& operator=(const Command&)=delete;
         Command(Command&&)noexcept=default;
 
-        Command& Arg(std::string arg){
-            current_cmd_.emplace_back(std::move(arg));
+        Command& Arg(const std::string& arg){
+            appendArg(arg.data(), arg.size());
             return *this;
         }
         Command& Arg(const char* arg){
-            current_cmd_.emplace_back(std::string(arg));
+            appendArg(arg, std::strlen(arg));
+            return *this;
+        }
+        Command& Arg(std::string_view arg){
+            appendArg(arg.data(), arg.size());
             return *this;
         }
-        Command& Key(std::string arg) {
+        //大于ARG_COPY_MAX的IOBuf直接挂到发送链上, 不拷贝数据; 之后不能再修改它的内容
+        Command& Arg(std::unique_ptr<folly::IOBuf> arg){
+            appendArg(std::move(arg));
+            return *this;
+        }
+        Command& Key(const std::string& arg) {
             current_key_ = arg;
-            current_cmd_.emplace_back(std::move(arg));
+            current_key_arg_ = static_cast<int32_t>(argc_);
+            appendArg(arg.data(), arg.size());
             return *this;
         }
         Command& Key(const char* arg) {
             current_key_ = arg;
-            current_cmd_.emplace_back(std::string(arg));
+            current_key_arg_ = static_cast<int32_t>(argc_);
+            appendArg(arg, std::strlen(arg));
             return *this;
         }
         Command& SetKey(std::string arg) {
             current_key_ = std::move(arg);
+            current_key_arg_ = -1;
             return *this;
         }
-        template<class T>
+        //字符串以外的类型先转成字符串
+        template<class T, std::enable_if_t<NeedConvertArg<T>, int> = 0>
         Command& Arg(T&& t){
-            current_cmd_.emplace_back(folly::to<std::string>(std::forward<T>(t)));
+            const auto str = folly::to<std::string>(std::forward<T>(t));
+            appendArg(str.data(), str.size());
             return *this;
         }
         template<class T>
@@ -75,48 +120,76 @@ namespace redis{
             }
             return *this;
         }
+        Command& Arg(std::vector<std::unique_ptr<folly::IOBuf>> bufs)
+        {
+            for (auto& buf : bufs)
+            {
+                Arg(std::move(buf));
+            }
+            return *this;
+        }
         Command& Ignore(){
             current_ignore_=true;
             return *this;
         }
-        Command& Cmd(std::string cmd){
-            if(!pipe_ && !current_cmd_.empty()){
+        Command& Cmd(const std::string& cmd){
+            if(!pipe_ && argc_ != 0){
+                folly::throw_exception(std::invalid_argument("multi Cmd can only call with pipe"));
+            }
+            buildCommand();
+            appendArg(cmd.data(), cmd.size());
+            return *this;
+        }
+        //参数个数固定的命令, 前缀整段拷贝
+        template<std::size_t ARGC, std::size_t N>
+        Command& Cmd(const CommandPrefix<ARGC, N>& prefix){
+            if(!pipe_ && argc_ != 0){
                 folly::throw_exception(std::invalid_argument("multi Cmd can only call with pipe"));
             }
             buildCommand();
-            current_cmd_.emplace_back(std::move(cmd));
+            std::memcpy(allocate(prefix.SIZE), prefix.data, prefix.SIZE);
+            argc_ = 1;
+            fixed_argc_ = ARGC;
+            fixed_header_ = prefix.HEADER_SIZE;
             return *this;
         }
     public:
         Self& Auth( const std::string& password)
         {
-            return Cmd("AUTH").Arg(password);
+            return Cmd(prefix::AUTH).Arg(password);
         }
         Self& Select( int index)
         {
-            return Cmd("SELECT").Arg(index);
+            return Cmd(prefix::SELECT).Arg(index);
+        }
+        Self& Hello( int protover)
+        {
+            return Cmd(prefix::HELLO).Arg(protover);
         }
     //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
     //string
     public:
         //std::string
-        Self& Append( const std::string& key, const std::string& value){
-            return Cmd("APPEND").Key(key).Arg(value);
+        Self& Append( const std::string& key, std::string_view value){
+            return Cmd(prefix::APPEND).Key(key).Arg(value);
+        }
+        Self& Append( const std::string& key, std::unique_ptr<folly::IOBuf> value){
+            return Cmd(prefix::APPEND).Key(key).Arg(std::move(value));
         }
         Self& Decr( const std::string& key){
-            return Cmd("DECR").Key(key);
+            return Cmd(prefix::DECR).Key(key);
         }
         Self& Decrby( const std::string& key, int val){
-            return Cmd("DECRBY").Key(key).Arg(val);
+            return Cmd(prefix::DECRBY).Key(key).Arg(val);
         }
         Self& Incr( const std::string& key){
-            return Cmd("INCR").Key(key);
+            return Cmd(prefix::INCR).Key(key);
         }
         Self& Incrby( const std::string& key, int incr){
-            return Cmd("INCRBY").Key(key).Arg(incr);
+            return Cmd(prefix::INCRBY).Key(key).Arg(incr);
         }
         Self& IncrbyFloat( const std::string& key, float incr){
-            return Cmd("INCRBYFLOAT").Key(key).Arg(incr);
+            return Cmd(prefix::INCRBYFLOAT).Key(key).Arg(incr);
         }
         Self& Del( const std::vector<std::string>& keys){
             FOLLY_SAFE_CHECK(!keys.empty(), "redis DEL need at least one key");
@@ -127,26 +200,29 @@ namespace redis{
             auto& cmd = Cmd("EXISTS").SetKey(keys.front()).Arg(keys);
         }
         Self& Expire( const std::string& key, int seconds){
-            return Cmd("EXPIRE").Key(key).Arg(seconds);
+            return Cmd(prefix::EXPIRE).Key(key).Arg(seconds);
         }
         Self& ExpireAt( const std::string& key, int timestamp){
-            return Cmd("EXPIREAT").Key(key).Arg(timestamp);
+            return Cmd(prefix::EXPIREAT).Key(key).Arg(timestamp);
         }
         Self& Echo( const std::string& msg){
             return Cmd("Echo").Arg(msg);
         }
         Self& StrLen( const std::string& key){
-            return Cmd("STRLEN").Key(key);
+            return Cmd(prefix::STRLEN).Key(key);
         }
 
         Self& GetRange( const std::string& key, int start, int end){
-            return Cmd("GETRANGE").Key(key).Arg(start).Arg(end);
+            return Cmd(prefix::GETRANGE).Key(key).Arg(start).Arg(end);
+        }
+        Self& GetSet( const std::string& key, std::string_view val){
+            return Cmd(prefix::GETSET).Key(key).Arg(val);
         }
-        Self& GetSet( const std::string& key, const std::string& val){
-            return Cmd("GETSET").Key(key).Arg(val);
+        Self& GetSet( const std::string& key, std::unique_ptr<folly::IOBuf> val){
+            return Cmd(prefix::GETSET).Key(key).Arg(std::move(val));
         }
         Self& Get( const std::string& key){
-            return Cmd("GET").Key(key);
+            return Cmd(prefix::GET).Key(key);
         }
         Self& MGet( const std::vector<std::string>& keys){
             FOLLY_SAFE_CHECK(!keys.empty(), "redis MGET need at least one key");
@@ -181,62 +257,78 @@ namespace redis{
             }
             return cmd;
         }
-        Self& PSetEX( const std::string& key, int64_t ms, const std::string& val){
-            return Cmd("PSETEX").Key(key).Arg(ms).Arg(val);
+        Self& PSetEX( const std::string& key, int64_t ms, std::string_view val){
+            return Cmd(prefix::PSETEX).Key(key).Arg(ms).Arg(val);
+        }
+        Self& PSetEX( const std::string& key, int64_t ms, std::unique_ptr<folly::IOBuf> val){
+            return Cmd(prefix::PSETEX).Key(key).Arg(ms).Arg(std::move(val));
         }
-        Self& Set( const std::string& key, const std::string& value){
-            return Cmd("SET").Key(key).Arg(value);
+        Self& Set( const std::string& key, std::string_view value){
+            return Cmd(prefix::SET).Key(key).Arg(value);
         }
-        Self& SetAdvanced( const std::string& key, const std::string& value, bool ex, int ex_sec, bool px, int px_milli,
+        Self& Set( const std::string& key, std::unique_ptr<folly::IOBuf> value){
+            return Cmd(prefix::SET).Key(key).Arg(std::move(value));
+        }
+        Self& SetAdvanced( const std::string& key, std::string_view value, bool ex, int ex_sec, bool px, int px_milli,
                            bool nx, bool xx){
-            auto& cmd = Cmd("SET").Key(key).Arg(value);
-            if(ex) cmd.Arg("EX").Arg(ex_sec);
-            if(px)cmd.Arg("PX").Arg(px_milli);
-            if(nx)cmd.Arg("NX");
-            if(xx)cmd.Arg("XX");
-            return *this;
+            Cmd("SET").Key(key).Arg(value);
+            return setOptions(ex, ex_sec, px, px_milli, nx, xx);
+        }
+        Self& SetAdvanced( const std::string& key, std::unique_ptr<folly::IOBuf> value, bool ex, int ex_sec, bool px, int px_milli,
+                           bool nx, bool xx){
+            Cmd("SET").Key(key).Arg(std::move(value));
+            return setOptions(ex, ex_sec, px, px_milli, nx, xx);
+        }
+        Self& SetEX( const std::string& key, int64_t seconds, std::string_view value){
+            return Cmd(prefix::SETEX).Key(key).Arg(seconds).Arg(value);
+        }
+        Self& SetEX( const std::string& key, int64_t seconds, std::unique_ptr<folly::IOBuf> value){
+            return Cmd(prefix::SETEX).Key(key).Arg(seconds).Arg(std::move(value));
+        }
+        Self& SetNX( const std::string& key, std::string_view value){
+            return Cmd(prefix::SETNX).Key(key).Arg(value);
         }
-        Self& SetEX( const std::string& key, int64_t seconds, const std::string& value){
-            return Cmd("SETEX").Key(key).Arg(seconds).Arg(value);
+        Self& SetNX( const std::string& key, std::unique_ptr<folly::IOBuf> value){
+            return Cmd(prefix::SETNX).Key(key).Arg(std::move(value));
         }
-        Self& SetNX( const std::string& key, const std::string& value){
-            return Cmd("SETNX").Key(key).Arg(value);
+        Self& SetRange( const std::string& key, int offset, std::string_view value){
+            return Cmd(prefix::SETRANGE).Key(key).Arg(offset).Arg(value);
         }
-        Self& SetRange( const std::string& key, int offset, const std::string& value){
-            return Cmd("SETRANGE").Key(key).Arg(offset).Arg(value);
+        Self& SetRange( const std::string& key, int offset, std::unique_ptr<folly::IOBuf> value){
+            return Cmd(prefix::SETRANGE).Key(key).Arg(offset).Arg(std::move(value));
         }
         Self& PExpire( const std::string& key, int ms){
-            return Cmd("PEXPIRE").Key(key).Arg(ms);
+            return Cmd(prefix::PEXPIRE).Key(key).Arg(ms);
         }
         Self& PExpireAt( const std::string& key, int ms_timestamp){
-            return Cmd("PEXPIREAT").Key(key).Arg(ms_timestamp);
+            return Cmd(prefix::PEXPIREAT).Key(key).Arg(ms_timestamp);
         }
 
         Self& Ping(){
-            return Cmd("PING");
+            return Cmd(prefix::PING_1);
         }
         Self& Ping( const std::string& message){
-            return Cmd("PING").Arg(message);
+            return Cmd(prefix::PING_2).Arg(message);
         }
 
         Self& PTtl( const std::string& key){
-            return Cmd("PTTL").Key(key);
+            return Cmd(prefix::PTTL).Key(key);
         }
         Self& Ttl( const std::string& key){
-            return Cmd("TTL").Key(key);
+            return Cmd(prefix::TTL).Key(key);
         }
         Self& Quit( ){
-            return Cmd("QUIT");
+            return Cmd(prefix::QUIT);
         }
         Self& Type( const std::string& key){
-            return Cmd("TYPE").Key(key);
+            return Cmd(prefix::TYPE).Key(key);
         }
 
         Self& Rename( const std::string& key, const std::string& newkey){
-            return Cmd("RENAME").Key(key).Arg(newkey);
+            return Cmd(prefix::RENAME).Key(key).Arg(newkey);
         }
         Self& RenameNX( const std::string& key, const std::string& newkey){
-            return Cmd("RENAMENX").Key(key).Arg(newkey);
+            return Cmd(prefix::RENAMENX).Key(key).Arg(newkey);
         }
 
         Self& Scan( std::size_t cursor){
@@ -293,11 +385,11 @@ namespace redis{
         };
         Self& BitCount( const std::string& key)
         {
-            return Cmd("BITCOUNT").Key(key);
+            return Cmd(prefix::BITCOUNT_2).Key(key);
         }
         Self& BitCount( const std::string& key, int start, int end)
         {
-            return Cmd("BITCOUNT").Key(key).Arg(start).Arg(end);
+            return Cmd(prefix::BITCOUNT_4).Key(key).Arg(start).Arg(end);
         }
         Self& BitField( const std::string& key, const std::vector<BitFieldOperation>& operations)
         {
@@ -323,30 +415,34 @@ namespace redis{
         }
         Self& BitPos( const std::string& key, int bit)
         {
-            return Cmd("BITPOS").Key(key).Arg(bit);
+            return Cmd(prefix::BITPOS_3).Key(key).Arg(bit);
         }
         Self& BitPos( const std::string& key, int bit, int start)
         {
-            return Cmd("BITPOS").Key(key).Arg(bit).Arg(start);
+            return Cmd(prefix::BITPOS_4).Key(key).Arg(bit).Arg(start);
         }
         Self& BitPos( const std::string& key, int bit, int start, int end)
         {
-            return Cmd("BITPOS").Key(key).Arg(bit).Arg(start).Arg(end);
+            return Cmd(prefix::BITPOS_5).Key(key).Arg(bit).Arg(start).Arg(end);
         }
         Self& GetBit( const std::string& key, int offset)
         {
-            return Cmd("GETBIT").Key(key).Arg(offset);
+            return Cmd(prefix::GETBIT).Key(key).Arg(offset);
         }
         Self& SetBit( const std::string& key, int offset, const std::string& value)
         {
-            return Cmd("SETBIT").Key(key).Arg(offset).Arg(value);
+            return Cmd(prefix::SETBIT).Key(key).Arg(offset).Arg(value);
         }
     public:
         ////////////////////////////////////////////////////////////////////////////
         //pubsub
-        Self& Publish( const std::string& channel, const std::string& message)
+        Self& Publish( const std::string& channel, std::string_view message)
         {
-            return Cmd("PUBLISH").Arg(channel).Arg(message);
+            return Cmd(prefix::PUBLISH).Arg(channel).Arg(message);
+        }
+        Self& Publish( const std::string& channel, std::unique_ptr<folly::IOBuf> message)
+        {
+            return Cmd(prefix::PUBLISH).Arg(channel).Arg(std::move(message));
         }
         Self& PubSub( const std::string& subcommand, const std::vector<std::string>& args)
         {
@@ -356,19 +452,19 @@ namespace redis{
         ////////////////////////////////////////////////////////////////////////////
         //transaction
         Self& Multi() {
-            return Cmd("MULTI");
+            return Cmd(prefix::MULTI);
         }
         Self& Exec()
         {
-            return Cmd("EXEC");
+            return Cmd(prefix::EXEC);
         }
         Self& DisCard()
         {
-            return Cmd("DISCARD");
+            return Cmd(prefix::DISCARD);
         }
         Self& UnWatch()
         {
-            return Cmd("UNWATCH");
+            return Cmd(prefix::UNWATCH);
         }
         Self& Watch( const std::vector<std::string>& keys)
         {
@@ -435,31 +531,31 @@ namespace redis{
         }
         Self& HExists( const std::string& key, const std::string& field )
         {
-            return Cmd("HEXISTS").Key(key).Arg(field);
+            return Cmd(prefix::HEXISTS).Key(key).Arg(field);
         }
         Self& HGet( const std::string& key, const std::string& field )
         {
-            return Cmd("HGET").Key(key).Arg(field);
+            return Cmd(prefix::HGET).Key(key).Arg(field);
         }
         Self& HGetAll( const std::string& key )
         {
-            return Cmd("HGETALL").Key(key);
+            return Cmd(prefix::HGETALL).Key(key);
         }
         Self& HIncrby( const std::string& key, const std::string& field, int incr )
         {
-            return Cmd("HINCRBY").Key(key).Arg(field).Arg(incr);
+            return Cmd(prefix::HINCRBY).Key(key).Arg(field).Arg(incr);
         }
         Self& HIncrbyFloat( const std::string& key, const std::string& field, float incr)
         {
-            return Cmd("HINCRBYFLOAT").Key(key).Arg(field).Arg(incr);
+            return Cmd(prefix::HINCRBYFLOAT).Key(key).Arg(field).Arg(incr);
         }
         Self& HKeys( const std::string& key )
         {
-            return Cmd("HKEYS").Key(key);
+            return Cmd(prefix::HKEYS).Key(key);
         }
         Self& HLen( const std::string& key )
         {
-            return Cmd("HLEN").Key(key);
+            return Cmd(prefix::HLEN).Key(key);
         }
         Self& HMGet( const std::string& key, const std::vector<std::string>& fields )
         {
@@ -493,21 +589,29 @@ namespace redis{
             if (count > 0)cmd.Arg("COUNT").Arg(count);
             return cmd;
         }
-        Self& HSet( const std::string& key, const std::string& field, const std::string& value)
+        Self& HSet( const std::string& key, const std::string& field, std::string_view value)
+        {
+            return Cmd(prefix::HSET).Key(key).Arg(field).Arg(value);
+        }
+        Self& HSet( const std::string& key, const std::string& field, std::unique_ptr<folly::IOBuf> value)
+        {
+            return Cmd(prefix::HSET).Key(key).Arg(field).Arg(std::move(value));
+        }
+        Self& HSetNX( const std::string& key, const std::string& field, std::string_view value)
         {
-            return Cmd("HSET").Key(key).Arg(field).Arg(value);
+            return Cmd(prefix::HSETNX).Key(key).Arg(field).Arg(value);
         }
-        Self& HSetNX( const std::string& key, const std::string& field, const std::string& value)
+        Self& HSetNX( const std::string& key, const std::string& field, std::unique_ptr<folly::IOBuf> value)
         {
-            return Cmd("HSETNX").Key(key).Arg(field).Arg(value);
+            return Cmd(prefix::HSETNX).Key(key).Arg(field).Arg(std::move(value));
         }
         Self& HStrLen( const std::string& key, const std::string& field )
         {
-            return Cmd("HSTRLEN").Key(key).Arg(field);
+            return Cmd(prefix::HSTRLEN).Key(key).Arg(field);
         }
         Self& HVals( const std::string& key )
         {
-            return Cmd("HVALS").Key(key);
+            return Cmd(prefix::HVALS).Key(key);
         }
     public:
         ////////////////////////////////////////////////////////////////////////////
@@ -518,7 +622,7 @@ namespace redis{
         }
         Self& SCard( const std::string& key )
         {
-            return Cmd("SCARD").Key(key);
+            return Cmd(prefix::SCARD).Key(key);
         }
         Self& SDiff( const std::vector<std::string>& keys )
         {
@@ -540,19 +644,19 @@ namespace redis{
         }
         Self& SIsmember( const std::string& key, const std::string& member )
         {
-            return Cmd("SISMEMBER").Key(key).Arg(member);
+            return Cmd(prefix::SISMEMBER).Key(key).Arg(member);
         }
         Self& SMembers( const std::string& key )
         {
-            return Cmd("SMEMBERS").Key(key);
+            return Cmd(prefix::SMEMBERS).Key(key);
         }
         Self& SMove( const std::string& source, const std::string& destination, const std::string& member)
         {
-            return Cmd("SMOVE").Key(source).Arg(destination).Arg(member);
+            return Cmd(prefix::SMOVE).Key(source).Arg(destination).Arg(member);
         }
         Self& SPop( const std::string& key )
         {
-            return Cmd("SPOP").Key(key);
+            return Cmd(prefix::SPOP).Key(key);
         }
         Self& SPop( const std::string& key, int count )
         {
@@ -560,11 +664,11 @@ namespace redis{
         }
         Self& SRandmember( const std::string& key )
         {
-            return Cmd("SRANDMEMBER").Key(key);
+            return Cmd(prefix::SRANDMEMBER_2).Key(key);
         }
         Self& SRandmember( const std::string& key, int count )
         {
-            return Cmd("SRANDMEMBER").Key(key).Arg(count);
+            return Cmd(prefix::SRANDMEMBER_3).Key(key).Arg(count);
         }
         Self& SRem( const std::string& key, const std::vector<std::string>& members )
         {
@@ -619,11 +723,11 @@ namespace redis{
         }
         Self& ZPopMin( const std::string& key, int count )
         {
-            return Cmd("ZPOPMIN").Key(key).Arg(count);
+            return Cmd(prefix::ZPOPMIN).Key(key).Arg(count);
         }
         Self& ZPopMax( const std::string& key, int count )
         {
-            return Cmd("ZPOPMAX").Key(key).Arg(count);
+            return Cmd(prefix::ZPOPMAX).Key(key).Arg(count);
         }
 
         Self& ZAdd( const std::string& key, const std::vector<std::string>& options,
@@ -639,31 +743,31 @@ namespace redis{
 
         Self& ZCard( const std::string& key )
         {
-            return Cmd("ZCARD").Key(key);
+            return Cmd(prefix::ZCARD).Key(key);
         }
         Self& ZCount( const std::string& key, int min, int max )
         {
-            return Cmd("ZCOUNT").Key(key).Arg(min).Arg(max);
+            return Cmd(prefix::ZCOUNT).Key(key).Arg(min).Arg(max);
         }
         Self& ZCount( const std::string& key, double min, double max )
         {
-            return Cmd("ZCOUNT").Key(key).Arg(min).Arg(max);
+            return Cmd(prefix::ZCOUNT).Key(key).Arg(min).Arg(max);
         }
         Self& ZCount( const std::string& key, const std::string& min, const std::string& max)
         {
-            return Cmd("ZCOUNT").Key(key).Arg(min).Arg(max);
+            return Cmd(prefix::ZCOUNT).Key(key).Arg(min).Arg(max);
         }
         Self& ZIncrby( const std::string& key, int incr, const std::string& member )
         {
-            return Cmd("ZINCRBY").Key(key).Arg(incr).Arg(member);
+            return Cmd(prefix::ZINCRBY).Key(key).Arg(incr).Arg(member);
         }
         Self& ZIncrby( const std::string& key, double incr, const std::string& member )
         {
-            return Cmd("ZINCRBY").Key(key).Arg(incr).Arg(member);
+            return Cmd(prefix::ZINCRBY).Key(key).Arg(incr).Arg(member);
         }
         Self& ZIncrby( const std::string& key, const std::string& incr, const std::string& member)
         {
-            return Cmd("ZINCRBY").Key(key).Arg(incr).Arg(member);
+            return Cmd(prefix::ZINCRBY).Key(key).Arg(incr).Arg(member);
         }
         Self& ZInterStore( const std::string& destination, std::size_t numkeys, const std::vector<std::string>& keys,
                            std::vector<std::size_t> weights, AggregateMethod method)
@@ -685,15 +789,15 @@ namespace redis{
         }
         Self& ZLexCount( const std::string& key, int min, int max )
         {
-            return Cmd("ZLEXCOUNT").Key(key).Arg(min).Arg(max);
+            return Cmd(prefix::ZLEXCOUNT).Key(key).Arg(min).Arg(max);
         }
         Self& ZLexCount( const std::string& key, double min, double max )
         {
-            return Cmd("ZLEXCOUNT").Key(key).Arg(min).Arg(max);
+            return Cmd(prefix::ZLEXCOUNT).Key(key).Arg(min).Arg(max);
         }
         Self& ZLexCount( const std::string& key, const std::string& min, const std::string& max)
         {
-            return Cmd("ZLEXCOUNT").Key(key).Arg(min).Arg(max);
+            return Cmd(prefix::ZLEXCOUNT).Key(key).Arg(min).Arg(max);
         }
         template<class T>
         Self& ZRange( const std::string& key, T start, T stop,bool withscores)
@@ -764,7 +868,7 @@ namespace redis{
 
         Self& ZRank( const std::string& key, const std::string& member )
         {
-            return Cmd("ZRANK").Key(key).Arg(member);
+            return Cmd(prefix::ZRANK).Key(key).Arg(member);
         }
 
         Self& ZRem( const std::string& key, const std::vector<std::string>& members )
@@ -775,17 +879,17 @@ namespace redis{
         template<class T>
         Self& ZRemRangeByLex( const std::string& key, T min, T max )
         {
-            return Cmd("ZREMRANGEBYLEX").Key(key).Arg(min).Arg(max);
+            return Cmd(prefix::ZREMRANGEBYLEX).Key(key).Arg(min).Arg(max);
         }
 
         template<class T>
         Self& ZRemRangeByRank( const std::string& key, T start, T stop ) {
-            return Cmd("ZREMRANGEBYRANK").Key(key).Arg(start).Arg(stop);
+            return Cmd(prefix::ZREMRANGEBYRANK).Key(key).Arg(start).Arg(stop);
         }
         template<class T>
         Self& ZRemRangeByScore( const std::string& key, T min, T max )
         {
-            return Cmd("ZREMRANGEBYSCORE").Key(key).Arg(min).Arg(max);
+            return Cmd(prefix::ZREMRANGEBYSCORE).Key(key).Arg(min).Arg(max);
         }
         template<class T>
         Self& ZRevRange(const std::string& key, T start, T stop)
@@ -851,7 +955,7 @@ namespace redis{
 
         Self& ZRevRank( const std::string& key, const std::string& member )
         {
-            return Cmd("ZREVRANK").Key(key).Arg(member);
+            return Cmd(prefix::ZREVRANK).Key(key).Arg(member);
         }
 
         Self& ZScan( const std::string& key, std::size_t cursor )
@@ -876,7 +980,7 @@ namespace redis{
 
         Self& ZScore( const std::string& key, const std::string& member )
         {
-            return Cmd("ZSCORE").Key(key).Arg(member);
+            return Cmd(prefix::ZSCORE).Key(key).Arg(member);
         }
 
         Self& ZUnionStore( const std::string& destination, std::size_t numkeys, const std::vector<std::string>& keys,
@@ -909,54 +1013,75 @@ namespace redis{
         }
         Self& BRpoplpush( const std::string& src, const std::string& dst, int timeout )
         {
-            return Cmd("BRPOPLPUSH").Key(src).Arg(dst).Arg(timeout);
+            return Cmd(prefix::BRPOPLPUSH).Key(src).Arg(dst).Arg(timeout);
         }
 
         Self& LIndex( const std::string& key, int index )
         {
-            return Cmd("LINDEX").Key(key).Arg(index);
+            return Cmd(prefix::LINDEX).Key(key).Arg(index);
         }
         Self& LInsert( const std::string& key, const std::string& before_after, const std::string& pivot,
-                       const std::string& value )
+                       std::string_view value )
         {
-            return Cmd("LINSERT").Key(key).Arg(before_after).Arg(pivot).Arg(value);
+            return Cmd(prefix::LINSERT).Key(key).Arg(before_after).Arg(pivot).Arg(value);
+        }
+        Self& LInsert( const std::string& key, const std::string& before_after, const std::string& pivot,
+                       std::unique_ptr<folly::IOBuf> value )
+        {
+            return Cmd(prefix::LINSERT).Key(key).Arg(before_after).Arg(pivot).Arg(std::move(value));
         }
         Self& LLen( const std::string& key )
         {
-            return Cmd("LLEN").Key(key);
+            return Cmd(prefix::LLEN).Key(key);
         }
         Self& LPop( const std::string& key )
         {
-            return Cmd("LPOP").Key(key);
+            return Cmd(prefix::LPOP).Key(key);
         }
         Self& LPush( const std::string& key, const std::vector<std::string>& values )
         {
             return Cmd("LPUSH").Key(key).Arg(values);
         }
-        Self& LPushX( const std::string& key, const std::string& value )
+        Self& LPush( const std::string& key, std::vector<std::unique_ptr<folly::IOBuf>> values )
+        {
+            return Cmd("LPUSH").Key(key).Arg(std::move(values));
+        }
+        Self& LPushX( const std::string& key, std::string_view value )
+        {
+            return Cmd(prefix::LPUSHX).Key(key).Arg(value);
+        }
+        Self& LPushX( const std::string& key, std::unique_ptr<folly::IOBuf> value )
         {
-            return Cmd("LPUSHX").Key(key).Arg(value);
+            return Cmd(prefix::LPUSHX).Key(key).Arg(std::move(value));
         }
         Self& LRange( const std::string& key, int start, int stop )
         {
-            return Cmd("LRANGE").Key(key).Arg(start).Arg(stop);
+            return Cmd(prefix::LRANGE).Key(key).Arg(start).Arg(stop);
+        }
+        Self& LRem( const std::string& key, int count, std::string_view value )
+        {
+            return Cmd(prefix::LREM).Key(key).Arg(count).Arg(value);
         }
-        Self& LRem( const std::string& key, int count, const std::string& value )
+        Self& LRem( const std::string& key, int count, std::unique_ptr<folly::IOBuf> value )
         {
-            return Cmd("LREM").Key(key).Arg(count).Arg(value);
+            return Cmd(prefix::LREM).Key(key).Arg(count).Arg(std::move(value));
         }
-        Self& LSet( const std::string& key, int index, const std::string& value )
+        Self& LSet( const std::string& key, int index, std::string_view value )
         {
-            return Cmd("LSET").Key(key).Arg(index).Arg(value);
+            return Cmd(prefix::LSET).Key(key).Arg(index).Arg(value);
+        }
+        Self& LSet( const std::string& key, int index, std::unique_ptr<folly::IOBuf> value )
+        {
+            return Cmd(prefix::LSET).Key(key).Arg(index).Arg(std::move(value));
         }
         Self& LTrim( const std::string& key, int start, int stop )
         {
-            return Cmd("LTRIM").Key(key).Arg(start).Arg(stop);
+            return Cmd(prefix::LTRIM).Key(key).Arg(start).Arg(stop);
         }
 
         Self& RPop( const std::string& key )
         {
-            return Cmd("LPOP").Key(key);
+            return Cmd(prefix::LPOP).Key(key);
         }
         Self& RPopLPush( const std::string& source, const std::string& destination )
         {
@@ -966,9 +1091,17 @@ namespace redis{
         {
             return Cmd("RPUSH").Key(key).Arg(values);
         }
-        Self& RPushX( const std::string& key, const std::string& value )
+        Self& RPush( const std::string& key, std::vector<std::unique_ptr<folly::IOBuf>> values )
+        {
+            return Cmd("RPUSH").Key(key).Arg(std::move(values));
+        }
+        Self& RPushX( const std::string& key, std::string_view value )
+        {
+            return Cmd(prefix::RPUSHX).Key(key).Arg(value);
+        }
+        Self& RPushX( const std::string& key, std::unique_ptr<folly::IOBuf> value )
         {
-            return Cmd("RPUSHX").Key(key).Arg(value);
+            return Cmd(prefix::RPUSHX).Key(key).Arg(std::move(value));
         }
     public:
         ////////////////////////////////////////////////////////////////////////////
@@ -1018,6 +1151,15 @@ namespace redis{
             }
             return cmd;
         }
+        Self& XAdd( const std::string& key, const std::string& id, std::vector<std::pair<std::string, std::unique_ptr<folly::IOBuf>>> field_members )
+        {
+            auto& cmd = Cmd("XADD").Key(key).Arg(id);
+            for(auto& kv:field_members)
+            {
+                cmd.Arg(kv.first).Arg(std::move(kv.second));
+            }
+            return cmd;
+        }
         Self& XClaim( const std::string& stream, const std::string& group, const std::string& consumer, int min_idle_time,
                       const std::vector<std::string>& message_ids, const XClaimOption& options)
         {
@@ -1079,7 +1221,7 @@ namespace redis{
         }
         Self& XLen( const std::string& stream )
         {
-            return Cmd("XLEN").Key(stream);
+            return Cmd(prefix::XLEN).Key(stream);
         }
         Self& XPending( const std::string& stream, const std::string& group, const XPendingOption& options )
         {
@@ -1130,6 +1272,26 @@ namespace redis{
     public:
         //执行结果
         folly::Future<Reply> Query();
+        //流式读取大的bulk string, cb在IO线程执行, 见Conn::QueryStream
+        folly::Future<Reply> QueryStream(ChunkCallback cb);
+        /**
+         * 回包交给visitor解析, 见Conn::QueryVisit; 只能有一个命令
+         * redis返回错误时future是异常
+         */
+        folly::Future<folly::Unit> Query(std::shared_ptr<ReplyVisitor> visitor);
+        /**
+         * 执行结果直接从读缓冲解析成T, 不构造Reply树, T的支持见decoder.h
+         * 只能有一个命令; redis返回错误或者类型不匹配时future是异常
+         */
+        template<class T>
+        folly::Future<T> Query()
+        {
+            auto visitor = std::make_shared<decode::TypedVisitor<T>>();
+            return Query(visitor).thenValue([visitor](folly::Unit)
+            {
+                return visitor->Result();
+            });
+        }
         //不关心结果
         void Run();
         Self& Build()
@@ -1140,11 +1302,11 @@ namespace redis{
     public:
         folly::IOBufQueue Serialize()const;
         void SerializeTo(folly::IOBufQueue& buf)const;
-        std::vector<CommandVal> Commands()&&
+        CommandList Commands()&&
         {
             return std::move(cmds_);
         }
-        const std::vector<CommandVal>& Commands()const&
+        const CommandList& Commands()const&
         {
             return cmds_;
         }
@@ -1152,8 +1314,32 @@ namespace redis{
         {
             return cmds_.empty();
         }
+        //回包交给visitor, 不构造Reply树
+        Self& SetVisitor(std::shared_ptr<ReplyVisitor> visitor)
+        {
+            visitor_ = std::move(visitor);
+            return *this;
+        }
+        const std::shared_ptr<ReplyVisitor>& Visitor()const
+        {
+            return visitor_;
+        }
+        /**
+         * 超时时间, 从提交时开始计算, 0表示不超时; 超时后future是folly::FutureTimeout异常
+         * 还没写出的命令直接丢弃, 已经写出的命令回包到达时丢弃, 见Conn
+         */
+        Self& SetTimeout(std::chrono::milliseconds timeout)
+        {
+            timeout_ = timeout;
+            return *this;
+        }
+        std::chrono::milliseconds Timeout()const
+        {
+            return timeout_;
+        }
     private:
         friend class ClientInterface;
+        friend class PreparedCommand;
         explicit Command(std::shared_ptr<ClientInterface> client):pipe_(false),client_(std::move(client)){
             XLOG(DBG,"COMMAND new");
         };
@@ -1163,27 +1349,123 @@ namespace redis{
         Command(std::shared_ptr<ClientInterface> client,std::string key,bool pipe):pipe_(pipe),client_(std::move(client)){
             XLOG(DBG,"COMMAND new");
             if(!key.empty()){
-                current_cmd_.emplace_back(std::move(key));
+                appendArg(key.data(), key.size());
+            }
+        }
+        //追加一条已经序列化好的命令
+        void appendSerialized(std::unique_ptr<folly::IOBuf> cmd, std::string key){
+            if(!pipe_ && (argc_ != 0 || !cmds_.empty())){
+                folly::throw_exception(std::invalid_argument("multi Cmd can only call with pipe"));
             }
+            buildCommand();
+            cmds_.emplace_back(std::move(cmd), std::move(key), false);
+        }
+        //写"$len\r\n", 返回长度
+        static std::size_t argPrefix(char* out, std::size_t len){
+            out[0] = '$';
+            std::size_t n = 1 + folly::uint64ToBufferUnsafe(len, out + 1);
+            out[n++] = '\r';
+            out[n++] = '\n';
+            return n;
+        }
+        //在args_尾部分配n字节连续空间
+        char* allocate(std::size_t n){
+            if(args_.empty()){
+                //新命令的第一个buffer, 前面留出"*N\r\n"的位置
+                auto first = folly::IOBuf::create(HEADER_ROOM + std::max(n, ARG_BUFFER_SIZE));
+                first->advance(HEADER_ROOM);
+                args_.append(std::move(first));
+            }
+            auto buf = args_.preallocate(n, std::max(n, ARG_BUFFER_SIZE)).first;
+            args_.postallocate(n);
+            return static_cast<char*>(buf);
+        }
+        //"$len\r\n" + arg + "\r\n" 直接写进args_的尾部
+        void appendArg(const char* data, std::size_t len){
+            char prefix[24];
+            const auto n = argPrefix(prefix, len);
+            auto* out = allocate(n + len + 2);
+            std::memcpy(out, prefix, n);
+            if(len > 0)std::memcpy(out + n, data, len);
+            out[n + len] = '\r';
+            out[n + len + 1] = '\n';
+            argc_ += 1;
+        }
+        void appendArg(std::unique_ptr<folly::IOBuf> arg){
+            const auto len = arg ? arg->computeChainDataLength() : 0;
+            char prefix[24];
+            const auto n = argPrefix(prefix, len);
+            if(len <= ARG_COPY_MAX){
+                auto* out = allocate(n + len + 2);
+                std::memcpy(out, prefix, n);
+                out += n;
+                if(arg){
+                    for(auto range : *arg){
+                        if(range.size() == 0)continue;
+                        std::memcpy(out, range.data(), range.size());
+                        out += range.size();
+                    }
+                }
+                out[0] = '\r';
+                out[1] = '\n';
+            }else{
+                std::memcpy(allocate(n), prefix, n);
+                args_.append(std::move(arg));
+                std::memcpy(allocate(2), "\r\n", 2);
+            }
+            argc_ += 1;
+        }
+        //SetAdvanced的选项部分
+        Self& setOptions(bool ex, int ex_sec, bool px, int px_milli, bool nx, bool xx){
+            if(ex)Arg("EX").Arg(ex_sec);
+            if(px)Arg("PX").Arg(px_milli);
+            if(nx)Arg("NX");
+            if(xx)Arg("XX");
+            return *this;
         }
         void buildCommand(){
-            if(current_cmd_.empty())return;
-            std::string result = folly::to<std::string>("*",current_cmd_.size(),"\r\n");
-            for ( const auto& part : current_cmd_ ) {
-                folly::toAppend("$",part.length(),"\r\n",part,"\r\n",&result);
+            if(argc_ == 0)return;
+            auto cmd = args_.move();
+            if(argc_ != fixed_argc_){
+                //预先生成的"*N\r\n"和实际的参数个数不一致时重写
+                cmd->trimStart(fixed_header_);
+                char header[HEADER_ROOM];
+                header[0] = '*';
+                std::size_t n = 1 + folly::uint64ToBufferUnsafe(argc_, header + 1);
+                header[n++] = '\r';
+                header[n++] = '\n';
+                cmd->prepend(n);
+                std::memcpy(cmd->writableData(), header, n);
             }
-            cmds_.emplace_back(std::move(result),std::move(current_key_), current_ignore_);
-            current_cmd_.clear();
+            cmds_.emplace_back(std::move(cmd),std::move(current_key_), current_ignore_, current_key_arg_);
+            argc_ = 0;
+            fixed_argc_ = 0;
+            fixed_header_ = 0;
             current_key_.clear();
+            current_key_arg_ = -1;
             current_ignore_=false;
         }
     private:
-        std::vector<std::string> current_cmd_;
+        //"*N\r\n"最长的长度
+        static constexpr std::size_t HEADER_ROOM = 24;
+        //每个命令参数buffer的最小大小
+        static constexpr std::size_t ARG_BUFFER_SIZE = 256;
+        //不超过这个长度的IOBuf参数直接拷贝, 和IOBufQueue合并小buffer的上限一致
+        static constexpr std::size_t ARG_COPY_MAX = 4096;
+        //正在构造的命令, 已经序列化的参数
+        folly::IOBufQueue args_{folly::IOBufQueue::cacheChainLength()};
+        std::size_t argc_{0};
+        //Cmd(CommandPrefix)写入的参数个数和"*N\r\n"的长度
+        std::size_t fixed_argc_{0};
+        std::size_t fixed_header_{0};
         std::string current_key_;
+        int32_t current_key_arg_{-1};
         bool current_ignore_{false};
 
-        std::vector<CommandVal> cmds_;
+        CommandList cmds_;
         bool pipe_{false};
         std::shared_ptr<ClientInterface> client_;
+        std::shared_ptr<ReplyVisitor> visitor_;
+        std::chrono::milliseconds timeout_{0};
     };
 }
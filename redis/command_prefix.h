@@ -0,0 +1,150 @@
+#pragma once
+#include <cstddef>
+/**
+ * 参数个数固定的命令, "*N\r\n$len\r\nNAME\r\n"在编译期生成,
+ * 运行时整段拷贝, 只有key和参数需要格式化
+ */
+namespace redis
+{
+    template <std::size_t ARGC, std::size_t N>
+    struct CommandPrefix
+    {
+        static_assert( ARGC > 0, "command needs a name" );
+        static constexpr std::size_t Digits( std::size_t v )
+        {
+            std::size_t n = 1;
+            while ( v >= 10 ) {
+                v /= 10;
+                n++;
+            }
+            return n;
+        }
+        //"*N\r\n"的长度
+        static constexpr std::size_t HEADER_SIZE = 1 + Digits( ARGC ) + 2;
+        static constexpr std::size_t SIZE = HEADER_SIZE + 1 + Digits( N - 1 ) + 2 + ( N - 1 ) + 2;
+        static constexpr std::size_t ARGS = ARGC;
+
+        constexpr explicit CommandPrefix( const char ( &name )[N] )
+        {
+            std::size_t pos = put( 0, '*', ARGC );
+            pos = put( pos, '$', N - 1 );
+            for ( std::size_t i = 0; i + 1 < N; i++ ) {
+                data[pos++] = name[i];
+            }
+            data[pos++] = '\r';
+            data[pos++] = '\n';
+        }
+        char data[SIZE]{};
+    private:
+        //写"<type><v>\r\n"
+        constexpr std::size_t put( std::size_t pos, char type, std::size_t v )
+        {
+            data[pos++] = type;
+            const auto digits = Digits( v );
+            for ( std::size_t i = digits; i > 0; i-- ) {
+                data[pos + i - 1] = static_cast<char>( '0' + v % 10 );
+                v /= 10;
+            }
+            pos += digits;
+            data[pos++] = '\r';
+            data[pos++] = '\n';
+            return pos;
+        }
+    };
+
+    //ARGC包含命令名本身
+    template <std::size_t ARGC, std::size_t N>
+    constexpr CommandPrefix<ARGC, N> MakeCommandPrefix( const char ( &name )[N] )
+    {
+        return CommandPrefix<ARGC, N>( name );
+    }
+
+    //command.h中用到的前缀, 同名命令参数个数不同时加上参数个数
+    namespace prefix
+    {
+        inline constexpr auto APPEND = MakeCommandPrefix<3>("APPEND");
+        inline constexpr auto AUTH = MakeCommandPrefix<2>("AUTH");
+        inline constexpr auto BITCOUNT_2 = MakeCommandPrefix<2>("BITCOUNT");
+        inline constexpr auto BITCOUNT_4 = MakeCommandPrefix<4>("BITCOUNT");
+        inline constexpr auto BITPOS_3 = MakeCommandPrefix<3>("BITPOS");
+        inline constexpr auto BITPOS_4 = MakeCommandPrefix<4>("BITPOS");
+        inline constexpr auto BITPOS_5 = MakeCommandPrefix<5>("BITPOS");
+        inline constexpr auto BRPOPLPUSH = MakeCommandPrefix<4>("BRPOPLPUSH");
+        inline constexpr auto DECR = MakeCommandPrefix<2>("DECR");
+        inline constexpr auto DECRBY = MakeCommandPrefix<3>("DECRBY");
+        inline constexpr auto DISCARD = MakeCommandPrefix<1>("DISCARD");
+        inline constexpr auto EXEC = MakeCommandPrefix<1>("EXEC");
+        inline constexpr auto EXPIRE = MakeCommandPrefix<3>("EXPIRE");
+        inline constexpr auto EXPIREAT = MakeCommandPrefix<3>("EXPIREAT");
+        inline constexpr auto GET = MakeCommandPrefix<2>("GET");
+        inline constexpr auto GETBIT = MakeCommandPrefix<3>("GETBIT");
+        inline constexpr auto GETRANGE = MakeCommandPrefix<4>("GETRANGE");
+        inline constexpr auto GETSET = MakeCommandPrefix<3>("GETSET");
+        inline constexpr auto HELLO = MakeCommandPrefix<2>("HELLO");
+        inline constexpr auto HEXISTS = MakeCommandPrefix<3>("HEXISTS");
+        inline constexpr auto HGET = MakeCommandPrefix<3>("HGET");
+        inline constexpr auto HGETALL = MakeCommandPrefix<2>("HGETALL");
+        inline constexpr auto HINCRBY = MakeCommandPrefix<4>("HINCRBY");
+        inline constexpr auto HINCRBYFLOAT = MakeCommandPrefix<4>("HINCRBYFLOAT");
+        inline constexpr auto HKEYS = MakeCommandPrefix<2>("HKEYS");
+        inline constexpr auto HLEN = MakeCommandPrefix<2>("HLEN");
+        inline constexpr auto HSET = MakeCommandPrefix<4>("HSET");
+        inline constexpr auto HSETNX = MakeCommandPrefix<4>("HSETNX");
+        inline constexpr auto HSTRLEN = MakeCommandPrefix<3>("HSTRLEN");
+        inline constexpr auto HVALS = MakeCommandPrefix<2>("HVALS");
+        inline constexpr auto INCR = MakeCommandPrefix<2>("INCR");
+        inline constexpr auto INCRBY = MakeCommandPrefix<3>("INCRBY");
+        inline constexpr auto INCRBYFLOAT = MakeCommandPrefix<3>("INCRBYFLOAT");
+        inline constexpr auto LINDEX = MakeCommandPrefix<3>("LINDEX");
+        inline constexpr auto LINSERT = MakeCommandPrefix<5>("LINSERT");
+        inline constexpr auto LLEN = MakeCommandPrefix<2>("LLEN");
+        inline constexpr auto LPOP = MakeCommandPrefix<2>("LPOP");
+        inline constexpr auto LPUSHX = MakeCommandPrefix<3>("LPUSHX");
+        inline constexpr auto LRANGE = MakeCommandPrefix<4>("LRANGE");
+        inline constexpr auto LREM = MakeCommandPrefix<4>("LREM");
+        inline constexpr auto LSET = MakeCommandPrefix<4>("LSET");
+        inline constexpr auto LTRIM = MakeCommandPrefix<4>("LTRIM");
+        inline constexpr auto MULTI = MakeCommandPrefix<1>("MULTI");
+        inline constexpr auto PEXPIRE = MakeCommandPrefix<3>("PEXPIRE");
+        inline constexpr auto PEXPIREAT = MakeCommandPrefix<3>("PEXPIREAT");
+        inline constexpr auto PING_1 = MakeCommandPrefix<1>("PING");
+        inline constexpr auto PING_2 = MakeCommandPrefix<2>("PING");
+        inline constexpr auto PSETEX = MakeCommandPrefix<4>("PSETEX");
+        inline constexpr auto PTTL = MakeCommandPrefix<2>("PTTL");
+        inline constexpr auto PUBLISH = MakeCommandPrefix<3>("PUBLISH");
+        inline constexpr auto QUIT = MakeCommandPrefix<1>("QUIT");
+        inline constexpr auto RENAME = MakeCommandPrefix<3>("RENAME");
+        inline constexpr auto RENAMENX = MakeCommandPrefix<3>("RENAMENX");
+        inline constexpr auto RPUSHX = MakeCommandPrefix<3>("RPUSHX");
+        inline constexpr auto SCARD = MakeCommandPrefix<2>("SCARD");
+        inline constexpr auto SELECT = MakeCommandPrefix<2>("SELECT");
+        inline constexpr auto SET = MakeCommandPrefix<3>("SET");
+        inline constexpr auto SETBIT = MakeCommandPrefix<4>("SETBIT");
+        inline constexpr auto SETEX = MakeCommandPrefix<4>("SETEX");
+        inline constexpr auto SETNX = MakeCommandPrefix<3>("SETNX");
+        inline constexpr auto SETRANGE = MakeCommandPrefix<4>("SETRANGE");
+        inline constexpr auto SISMEMBER = MakeCommandPrefix<3>("SISMEMBER");
+        inline constexpr auto SMEMBERS = MakeCommandPrefix<2>("SMEMBERS");
+        inline constexpr auto SMOVE = MakeCommandPrefix<4>("SMOVE");
+        inline constexpr auto SPOP = MakeCommandPrefix<2>("SPOP");
+        inline constexpr auto SRANDMEMBER_2 = MakeCommandPrefix<2>("SRANDMEMBER");
+        inline constexpr auto SRANDMEMBER_3 = MakeCommandPrefix<3>("SRANDMEMBER");
+        inline constexpr auto STRLEN = MakeCommandPrefix<2>("STRLEN");
+        inline constexpr auto TTL = MakeCommandPrefix<2>("TTL");
+        inline constexpr auto TYPE = MakeCommandPrefix<2>("TYPE");
+        inline constexpr auto UNWATCH = MakeCommandPrefix<1>("UNWATCH");
+        inline constexpr auto XLEN = MakeCommandPrefix<2>("XLEN");
+        inline constexpr auto ZCARD = MakeCommandPrefix<2>("ZCARD");
+        inline constexpr auto ZCOUNT = MakeCommandPrefix<4>("ZCOUNT");
+        inline constexpr auto ZINCRBY = MakeCommandPrefix<4>("ZINCRBY");
+        inline constexpr auto ZLEXCOUNT = MakeCommandPrefix<4>("ZLEXCOUNT");
+        inline constexpr auto ZPOPMAX = MakeCommandPrefix<3>("ZPOPMAX");
+        inline constexpr auto ZPOPMIN = MakeCommandPrefix<3>("ZPOPMIN");
+        inline constexpr auto ZRANK = MakeCommandPrefix<3>("ZRANK");
+        inline constexpr auto ZREMRANGEBYLEX = MakeCommandPrefix<4>("ZREMRANGEBYLEX");
+        inline constexpr auto ZREMRANGEBYRANK = MakeCommandPrefix<4>("ZREMRANGEBYRANK");
+        inline constexpr auto ZREMRANGEBYSCORE = MakeCommandPrefix<4>("ZREMRANGEBYSCORE");
+        inline constexpr auto ZREVRANK = MakeCommandPrefix<3>("ZREVRANK");
+        inline constexpr auto ZSCORE = MakeCommandPrefix<3>("ZSCORE");
+    }
+}
@@ -1,9 +1,10 @@
 #include "redis/conn.h"
 
-#include <folly/executors/GlobalExecutor.h>
 #include <folly/logging/xlog.h>
+#include <folly/portability/Sockets.h>
 
 #include "redis/cluster_client.h"
+#include "redis/io_pool.h"
 #include "redis/util.h"
 namespace redis
 {
@@ -15,18 +16,29 @@ namespace redis
         Close();
     }
 
-    folly::SemiFuture<folly::Unit> Conn::Connect(const std::string& host, int port, std::string pass/* = ""*/, int32_t db /*= 0*/, int32_t timeout_ms /*= 0 */ )
+    folly::SemiFuture<folly::Unit> Conn::Connect(const std::string& host, int port, std::string pass/* = ""*/, int32_t db /*= 0*/, int32_t timeout_ms /*= 0 */,
+        const ConnOptions& options)
     {
-        addr_.setFromHostPort(host,static_cast<uint16_t>(port));
+        options_ = options;
+        if (IsUnixPath(host))
+        {
+            //同机部署的redis, 走unix domain socket
+            addr_.setFromPath(host);
+        }
+        else
+        {
+            addr_.setFromHostPort(host,static_cast<uint16_t>(port));
+        }
         pass_ = std::move(pass);
         db_index_ = db;
         if(timeout_ms!=0)timeout_ms_=timeout_ms;
 
-        eventBase_ = folly::getGlobalIOExecutor()->getEventBase();
+        //只持有EventBase的KeepAlive, 线程池由调用方持有, 见SetIOPool
+        eventBase_ = GetIOPool()->getEventBase();
         eventBase_->runInEventBaseThread([shared=shared_from_this()]{
             XLOGF(DBG,"eventbase thread[{}]", folly::getOSThreadID());
             shared->cli_ = folly::AsyncSocket::newSocket(shared->eventBase_.get());
-            shared->cli_->connect(shared.get(),shared->addr_,shared->timeout_ms_);
+            shared->cli_->connect(shared.get(),shared->addr_,shared->timeout_ms_,shared->socketOptions());
         });
         return connectPromise_.getSemiFuture();
     }
@@ -35,9 +47,40 @@ namespace redis
     {
         if(closing)return;
         closing=true;
-        XLOGF(DBG,"close redis connect [{}]",addr_.getAddressStr());
+        XLOGF(DBG,"close redis connect [{}]",addr_.describe());
         if ( cli_ )cli_->getEventBase()->runImmediatelyOrRunInEventBaseThreadAndWait([this]{
             cli_.reset();
+            idle_shrink_.cancelTimeout();
+            //还没完成的命令都失败, 结果的回调再提交会因为closing直接失败
+            const std::runtime_error closed("redis conn is closed");
+            Submission sub;
+            while (submissions_.try_dequeue(sub)) {
+                if (!sub.cmd.ignore)sub.cmd.reply.setException(closed);
+            }
+            dropPendingWrites();
+            while (!cmds_.empty()) {
+                auto cmd = std::move(cmds_.front());
+                popCommand();
+                //定时器只能在IO线程取消
+                cmd.timer.reset();
+                //超时的命令promise已经设置过了
+                if (!cmd.ignore && !cmd.expired)cmd.reply.setException(closed);
+            }
+            custom_cmds_ = 0;
+            inflight_ = 0;
+            inflight_bytes_ = 0;
+            Waiter waiter;
+            while (waiters_.try_dequeue(waiter)) {
+                waiting_ -= 1;
+                if (!waiter.has_cmd)
+                {
+                    waiter.ready.setException(closed);
+                }
+                else if (!waiter.cmd.ignore)
+                {
+                    waiter.cmd.reply.setException(closed);
+                }
+            }
         });
     }
     bool Conn::IsConnected() const
@@ -46,24 +89,145 @@ namespace redis
     }
     void Conn::Send(std::unique_ptr<folly::IOBuf> buf)
     {
-        cli_->getEventBase()->runInEventBaseThread([shared = shared_from_this(), buf{ std::move(buf) }]()mutable 
+        auto evb = cli_->getEventBase();
+        if (evb->isInEventBaseThread())
+        {
+            //已经在IO线程, 直接写
+            writes_ += 1;
+            cli_->writeChain(this, std::move(buf));
+            return;
+        }
+        evb->runInEventBaseThread([shared = shared_from_this(), buf{ std::move(buf) }]()mutable 
         {
+            shared->writes_ += 1;
             shared->cli_->writeChain(shared.get(),std::move(buf));
         });
     }
+    void Conn::scheduleFlush(bool now)
+    {
+        if (now)
+        {
+            flushWrites();
+            return;
+        }
+        if (flush_scheduled_)return;
+        flush_scheduled_ = true;
+        //当前这轮事件循环结束时写出, 这轮中提交的命令都会合并进来
+        eventBase_->runInLoop([shared = shared_from_this()]{ shared->flushWrites(); });
+    }
+    void Conn::flushWrites()
+    {
+        flush_scheduled_ = false;
+        if (pending_expired_ != 0)dropUnsentExpired();
+        pending_cmds_ = 0;
+        write_gen_ += 1;
+        auto buf = pending_writes_.move();
+        if (!buf || !cli_)return;
+        writes_ += 1;
+        cli_->writeChain(this, std::move(buf));
+    }
+    void Conn::dropPendingWrites()
+    {
+        pending_writes_.move();
+        pending_cmds_ = 0;
+        pending_expired_ = 0;
+        write_gen_ += 1;
+    }
+    void Conn::dropUnsentExpired()
+    {
+        //写队列中的数据和其中的命令在cmds_中的顺序一致
+        pending_expired_ = 0;
+        folly::IOBufQueue kept(folly::IOBufQueue::cacheChainLength());
+        std::size_t dropped = 0;
+        std::size_t dropped_bytes = 0;
+        for (auto n = cmds_.size(); n > 0; n--) {
+            auto cmd = std::move(cmds_.front());
+            popCommand();
+            const bool unsent = cmd.wire_bytes != 0 && cmd.write_gen == write_gen_;
+            if (unsent)
+            {
+                auto data = pending_writes_.split(cmd.wire_bytes);
+                if (cmd.expired)
+                {
+                    //超时时promise已经设置了异常, 没有写出就不会有回包, 直接出队
+                    unsent_timeouts_ += 1;
+                    pending_cmds_ -= 1;
+                    if (cmd.chunk_cb || cmd.visitor)custom_cmds_ -= 1;
+                    dropped += 1;
+                    dropped_bytes += cmd.bytes;
+                    continue;
+                }
+                kept.append(std::move(data), true);
+            }
+            pushCommand(std::move(cmd), true);
+        }
+        pending_writes_ = std::move(kept);
+        //cmds_整理完再放行等待空位的提交, 放行的回调可能直接提交命令
+        inflight_ -= dropped;
+        inflight_bytes_ -= dropped_bytes;
+        if (waiting_ > 0)wakeWaiters();
+    }
 
     folly::SemiFuture<Reply> Conn::Query(Command cmd)
     {
         return queryInternal(std::move(cmd));
     }
 
+    folly::SemiFuture<Reply> Conn::QueryStream(Command cmd, ChunkCallback cb)
+    {
+        if (cmd.Build().Commands().size() != 1) {
+            return folly::makeFuture<Reply>(std::invalid_argument("streaming query needs exactly one command"));
+        }
+        if (!cb) {
+            return folly::makeFuture<Reply>(std::invalid_argument("streaming query needs a chunk callback"));
+        }
+        WaitingCommand wait;
+        wait.ignore = false;
+        wait.cmds = std::move(cmd).Commands();
+        wait.chunk_cb = std::move(cb);
+        setDeadline(wait, cmd);
+        wait.reply = folly::Promise<Reply>();
+        auto future = wait.reply.getSemiFuture();
+        if (admit(wait))run(std::move(wait));
+        return future;
+    }
+
+    folly::SemiFuture<Reply> Conn::QueryVisit(Command cmd, std::shared_ptr<ReplyVisitor> visitor)
+    {
+        if (!visitor) {
+            return folly::makeFuture<Reply>(std::invalid_argument("visitor query needs a visitor"));
+        }
+        cmd.SetVisitor(std::move(visitor));
+        return queryInternal(std::move(cmd));
+    }
+
     void Conn::Run(Command cmd)
     {
         if (cmd.Build().Empty())return;
         WaitingCommand wait;
         wait.ignore = true;
         wait.cmds = std::move(cmd).Commands();
-        run(std::move(wait));
+        setDeadline(wait, cmd);
+        if (admit(wait))run(std::move(wait));
+    }
+
+    folly::SemiFuture<Reply> Conn::QueryPrepared(std::unique_ptr<folly::IOBuf> cmd)
+    {
+        WaitingCommand wait;
+        wait.ignore = false;
+        wait.cmds.emplace_back(std::move(cmd), std::string(), false);
+        wait.reply = folly::Promise<Reply>();
+        auto future = wait.reply.getSemiFuture();
+        if (admit(wait))run(std::move(wait));
+        return future;
+    }
+
+    void Conn::RunPrepared(std::unique_ptr<folly::IOBuf> cmd)
+    {
+        WaitingCommand wait;
+        wait.ignore = true;
+        wait.cmds.emplace_back(std::move(cmd), std::string(), false);
+        if (admit(wait))run(std::move(wait));
     }
 
     folly::SemiFuture<Reply> Conn::queryInternal(Command cmd, bool append)
@@ -73,15 +237,241 @@ namespace redis
         }
         WaitingCommand wait;
         wait.ignore = false;
+        wait.visitor = cmd.Visitor();
+        if (wait.visitor && cmd.Commands().size() != 1) {
+            return folly::makeFuture<Reply>(std::invalid_argument("visitor query needs exactly one command"));
+        }
         wait.cmds = std::move(cmd).Commands();
+        setDeadline(wait, cmd);
+        wait.reply = folly::Promise<Reply>();
         auto future = wait.reply.getSemiFuture();
-        run(std::move(wait),append);
+        //连接时插到队头的命令(AUTH等)不受上限限制
+        if (!append || admit(wait))run(std::move(wait),append);
         return future;
     }
     void Conn::run(Conn::WaitingCommand &&cmd,bool append)
     {
-        std::unique_ptr<folly::IOBuf> sendbuf;
-        if(IsConnected())
+        if (!eventBase_)
+        {
+            if (!cmd.ignore)cmd.reply.setException(std::runtime_error("redis conn is not connected"));
+            return;
+        }
+        if (closing)
+        {
+            if (!cmd.ignore)cmd.reply.setException(std::runtime_error("redis conn is closed"));
+            return;
+        }
+        sends_ += 1;
+        cmd.bytes = 0;
+        for (auto& sub : cmd.cmds) {
+            cmd.bytes += sub.cmd->computeChainDataLength();
+        }
+        inflight_.fetch_add(1, std::memory_order_relaxed);
+        inflight_bytes_ += cmd.bytes;
+        if (eventBase_->isInEventBaseThread())
+        {
+            //先处理其他线程更早提交的命令, 保持顺序
+            drainSubmissions();
+            enqueue(std::move(cmd), append);
+            if (auto_pipeline_)
+            {
+                scheduleFlush(pending_cmds_ >= pipeline_cmds_ || pending_writes_.chainLength() >= pipeline_bytes_);
+            }
+            else
+            {
+                flushWrites();
+            }
+            return;
+        }
+        submissions_.enqueue(Submission{ std::move(cmd), append });
+        if (!drain_scheduled_.exchange(true))
+        {
+            eventBase_->runInEventBaseThread([shared = shared_from_this()]
+            {
+                shared->drain_scheduled_ = false;
+                shared->drainSubmissions();
+                shared->flushWrites();
+            });
+        }
+    }
+    void Conn::drainSubmissions()
+    {
+        Submission sub;
+        while (submissions_.try_dequeue(sub))
+        {
+            enqueue(std::move(sub.cmd), sub.append);
+            //没有开自动pipeline时每个命令单独写出
+            if (!auto_pipeline_)flushWrites();
+        }
+    }
+    bool Conn::Overloaded() const
+    {
+        return (limits_.max_inflight != 0 && inflight_ >= limits_.max_inflight)
+            || (limits_.max_inflight_bytes != 0 && inflight_bytes_ >= limits_.max_inflight_bytes);
+    }
+    folly::SemiFuture<folly::Unit> Conn::WaitCapacity()
+    {
+        if (!eventBase_ || (!Overloaded() && waiting_ == 0))return folly::makeSemiFuture();
+        Waiter waiter;
+        waiter.ready = folly::Promise<folly::Unit>();
+        auto future = waiter.ready.getSemiFuture();
+        addWaiter(std::move(waiter));
+        return future;
+    }
+    bool Conn::admit(WaitingCommand& cmd)
+    {
+        if (!eventBase_)return true;
+        if (!limits_.wait)
+        {
+            //不等待时只看上限, WaitCapacity()的等待者不影响
+            if (!Overloaded())return true;
+            rejected_ += 1;
+            if (cmd.ignore)
+            {
+                XLOGF(WARN,"redis conn[{}] is overloaded, drop command", addr_.describe());
+            }
+            else
+            {
+                cmd.reply.setException(ConnOverloaded());
+            }
+            return false;
+        }
+        //先来先到: 前面还有等待的提交时不能越过它们
+        if (!Overloaded() && waiting_ == 0)return true;
+        waits_ += 1;
+        Waiter waiter;
+        waiter.cmd = std::move(cmd);
+        waiter.has_cmd = true;
+        addWaiter(std::move(waiter));
+        return false;
+    }
+    void Conn::addWaiter(Waiter&& waiter)
+    {
+        //先计数再入队, 其他提交者看到waiting_就会排在后面
+        waiting_ += 1;
+        waiters_.enqueue(std::move(waiter));
+        //入队前IO线程可能刚好还回了位置并且没有看到这个等待者, 让它再检查一次
+        if (!Overloaded())
+        {
+            eventBase_->runInEventBaseThread([shared = shared_from_this()]{ shared->wakeWaiters(); });
+        }
+    }
+    void Conn::release(std::size_t bytes)
+    {
+        inflight_ -= 1;
+        inflight_bytes_ -= bytes;
+        if (waiting_ > 0)wakeWaiters();
+    }
+    void Conn::wakeWaiters()
+    {
+        //按入队顺序放行; 带命令的直接提交, 占用的位置马上计入, 不会和新的提交抢
+        Waiter waiter;
+        while (!Overloaded() && waiters_.try_dequeue(waiter))
+        {
+            waiting_ -= 1;
+            if (waiter.has_cmd)
+            {
+                run(std::move(waiter.cmd));
+            }
+            else
+            {
+                //WaitCapacity()的等待者之后自己提交, 不占位置
+                waiter.ready.setValue();
+            }
+        }
+    }
+    void Conn::setDeadline(WaitingCommand& wait, const Command& cmd)
+    {
+        if (cmd.Timeout().count() > 0)
+        {
+            wait.deadline = std::chrono::steady_clock::now() + cmd.Timeout();
+        }
+    }
+    bool Conn::armDeadline(WaitingCommand& cmd)
+    {
+        //重定向过来的命令沿用原来的截止时间
+        if (cmd.deadline == std::chrono::steady_clock::time_point())return true;
+        const auto now = std::chrono::steady_clock::now();
+        if (cmd.deadline <= now)
+        {
+            //在提交队列里就已经超时, 不再写出
+            timeouts_ += 1;
+            unsent_timeouts_ += 1;
+            release(cmd.bytes);
+            if (!cmd.ignore)cmd.reply.setException(folly::FutureTimeout());
+            return false;
+        }
+        cmd.timer = acquireTimer();
+        eventBase_->timer().scheduleTimeout(cmd.timer.get(),
+            std::chrono::duration_cast<std::chrono::milliseconds>(cmd.deadline - now));
+        return true;
+    }
+    Conn::DeadlinePtr Conn::acquireTimer()
+    {
+        if (free_timers_.empty())return DeadlinePtr(new Deadline(*this));
+        DeadlinePtr timer(free_timers_.back().release());
+        free_timers_.pop_back();
+        return timer;
+    }
+    void Conn::DeadlineRelease::operator()(Deadline* timer) const noexcept
+    {
+        //只在IO线程还回, 取消后才能复用
+        timer->cancelTimeout();
+        auto& pool = timer->conn_.free_timers_;
+        if (pool.size() >= kMaxFreeTimers)
+        {
+            delete timer;
+            return;
+        }
+        pool.emplace_back(timer);
+    }
+    void Conn::Deadline::timeoutExpired() noexcept
+    {
+        conn_.expire(this);
+    }
+    void Conn::expire(Deadline* timer)
+    {
+        const auto i = timer->seq - cmds_seq_;
+        if (i >= cmds_.size() || cmds_[i].timer.get() != timer)return;
+        auto& cmd = cmds_[i];
+        //命令留在cmds_里占住位置, 回包到达时丢弃, 后面的回包仍然按顺序对应
+        cmd.expired = true;
+        timeouts_ += 1;
+        //还在写队列里的, 写出前去掉
+        if (cmd.wire_bytes != 0 && cmd.write_gen == write_gen_)pending_expired_ += 1;
+        //正在解析它的回包, 剩下的部分不再回调
+        if (i == 0 && (cmd.chunk_cb || cmd.visitor))builder_.Detach();
+        if (!cmd.ignore)
+        {
+            //先移出来, 回调可能往cmds_里加命令
+            auto reply = std::move(cmd.reply);
+            reply.setException(folly::FutureTimeout());
+        }
+    }
+    void Conn::dropExpired()
+    {
+        //旧连接上的回包不会再来, 超时的命令不用重发了
+        for (auto n = cmds_.size(); n > 0; n--) {
+            auto cmd = std::move(cmds_.front());
+            popCommand();
+            if (!cmd.expired)
+            {
+                pushCommand(std::move(cmd), true);
+                continue;
+            }
+            unsent_timeouts_ += 1;
+            //重发之后才放行等待空位的提交, 见connectSuccess
+            inflight_ -= 1;
+            inflight_bytes_ -= cmd.bytes;
+            if (cmd.chunk_cb || cmd.visitor)custom_cmds_ -= 1;
+        }
+    }
+    void Conn::enqueue(WaitingCommand&& cmd, bool append)
+    {
+        //重定向过来或者没有进写队列的命令, 不能带着之前的值让dropUnsentExpired切错数据
+        cmd.wire_bytes = 0;
+        if (!armDeadline(cmd))return;
+        if (IsConnected())
         {
             folly::IOBufQueue buf(folly::IOBufQueue::cacheChainLength());
             bool ask = false;
@@ -89,31 +479,52 @@ namespace redis
             {
                 if(sub.rpl && (!sub.rpl->IsMovedError() && !sub.rpl->IsAskError()))continue;
                 if(sub.rpl && sub.rpl->IsAskError())ask=true;
-                buf.append(sub.cmd.data(),sub.cmd.size());
+                buf.append(*sub.cmd, true);
                 sub.rpl =std::nullopt;
             }
+            std::unique_ptr<folly::IOBuf> sendbuf;
             if(ask){
                 auto asking = Command::Create(false).Cmd("ASKING").Build().Serialize();
                 sendbuf = asking.move();
-                sendbuf->appendChain(buf.move());
+                sendbuf->prependChain(buf.move());
             }else{
                 sendbuf=buf.move();
             }
-        }
-        {
-            std::lock_guard<std::mutex> lock(cmds_mtx_);
-            if (append) {
-                cmds_.emplace_back(std::move(cmd));
+            if (append)
+            {
+                cmd.wire_bytes = sendbuf->computeChainDataLength();
+                cmd.write_gen = write_gen_;
+                pending_writes_.append(std::move(sendbuf), true);
+                pending_cmds_ += 1;
             }
             else
             {
-                cmds_.emplace_front(std::move(cmd));
+                //插到队头的命令(连接时的AUTH等)要先于写队列中的数据写出
+                writes_ += 1;
+                cli_->writeChain(this, std::move(sendbuf));
             }
         }
-        if(IsConnected())
+        if (cmd.chunk_cb || cmd.visitor)custom_cmds_ += 1;
+        pushCommand(std::move(cmd), append);
+    }
+    void Conn::pushCommand(WaitingCommand&& cmd, bool append)
+    {
+        if (append)
         {
-            Send(std::move(sendbuf));
+            if (cmd.timer)cmd.timer->seq = cmds_seq_ + cmds_.size();
+            cmds_.push_back(std::move(cmd));
         }
+        else
+        {
+            cmds_seq_ -= 1;
+            if (cmd.timer)cmd.timer->seq = cmds_seq_;
+            cmds_.push_front(std::move(cmd));
+        }
+    }
+    void Conn::popCommand()
+    {
+        cmds_.pop_front();
+        cmds_seq_ += 1;
     }
     bool Conn::hasRedirectError(WaitingCommand& cmd)
     {
@@ -135,17 +546,19 @@ namespace redis
     }
 
     void Conn::setReply(WaitingCommand& cmd){
-        Reply result;
+        if (cmd.ignore)return;
+        std::vector<Reply> rows;
+        rows.reserve(cmd.cmds.size());
         for (auto& cur : cmd.cmds) {
-            if (!cur.ignore) result << cur.rpl.value();
+            if (!cur.ignore) rows.push_back(std::move(cur.rpl.value()));
         }
-        if (result.AsArray().size() == 1 && !cmd.pipeline)
+        if (rows.size() == 1 && !cmd.pipeline)
         {
-            cmd.reply.setValue(std::move(std::move(result).AsArray()[0]));
+            cmd.reply.setValue(std::move(rows[0]));
         }
         else
         {
-            cmd.reply.setValue(std::move(result));
+            cmd.reply.setValue(Reply(std::move(rows)));
         }
     }
     void Conn::redirect(WaitingCommand&& cmd)
@@ -182,10 +595,13 @@ namespace redis
               setReply(cmd);
               return;
             }
+            const bool moved = hasMovedError(cmd);
+            //定时器属于当前的IO线程, 目标连接会重新设置
+            cmd.timer.reset();
             //TODO 线程安全
             conn->run(std::move(cmd));
             //moved error,刷新一下slots
-            if(hasMovedError(cmd) && !cluster_.expired()){
+            if(moved && !cluster_.expired()){
                 //TODO ??哪个线程处理??
                 cluster_.lock()->Update().via(conn->GetEventBase());
             }
@@ -193,8 +609,20 @@ namespace redis
     }
     void Conn::OnReply(Reply&& rpl)
     {
+        //push不对应任何命令, 不能占用等待队列里的位置
+        if(rpl.IsPush())
+        {
+            if(push_cb_)
+            {
+                push_cb_(std::move(rpl));
+            }
+            else if(IsSubscriberConn() && reply_cb_)
+            {
+                reply_cb_(std::move(rpl));
+            }
+            return;
+        }
         //TODO move,ask错误处理
-        std::lock_guard<std::mutex> lock(cmds_mtx_);
         if(cmds_.empty())
         {
             //pubsub
@@ -210,27 +638,36 @@ namespace redis
             size_t i = 0;
             for (; i < cmd.cmds.size(); i++) {
                 if (cmd.cmds[i].rpl)continue;
-                if (rpl.IsError())XLOGF(ERR,"redis command {} result error:{}", cmd.cmds[i].cmd, rpl.AsString());
+                if (rpl.IsError())XLOGF(ERR,"redis command {} result error:{}", cmd.cmds[i].ToString(), rpl.AsString());
                 cmd.cmds[i].rpl = std::move(rpl);
                 break;
             }
             //所有都回来了
             if (i == cmd.cmds.size() - 1) {
-                //集群链接,有重定向错误
-                if(IsClusterConn() && hasRedirectError(cmd)){
-                    redirect(std::move(cmd));
+                //集群链接,有重定向错误; 超时的命令不再重定向
+                if(IsClusterConn() && !cmd.expired && hasRedirectError(cmd)){
+                    //先出队, 重定向可能往cmds_里加命令
+                    auto done = std::move(cmd);
+                    popCommand();
+                    release(done.bytes);
+                    redirect(std::move(done));
+                }else
+                {
+                    const auto bytes = cmd.bytes;
+                    popCommand();
+                    release(bytes);
                 }
-                cmds_.pop_front();
             }
         }
         else
         {
+            const bool custom = cmd.chunk_cb || cmd.visitor;
             size_t i = 0;
             for (; i < cmd.cmds.size(); i++) {
                 auto& cur = cmd.cmds[i];
                 if (cur.rpl)continue;
                 if (cur.ignore && rpl.IsError()) {
-                    XLOGF(ERR,"redis command {} result error:{}", cur.cmd, rpl.AsString());
+                    XLOGF(ERR,"redis command {} result error:{}", cur.ToString(), rpl.AsString());
                 }
                 cur.rpl = std::move(rpl);
                 break;
@@ -238,14 +675,20 @@ namespace redis
             // 所有的reply都回来了
             if (i == cmd.cmds.size() - 1)
             {
-                if(IsClusterConn() && hasRedirectError(cmd))
+                //先出队, 重定向和结果的回调都可能往cmds_里加命令
+                auto done = std::move(cmd);
+                popCommand();
+                if (custom)custom_cmds_ -= 1;
+                release(done.bytes);
+                //已经超时返回了, 丢弃迟到的回包
+                if(done.expired)return;
+                if(IsClusterConn() && hasRedirectError(done))
                 {
-                    redirect(std::move(cmd));
+                    redirect(std::move(done));
                 }else
                 {
-                    setReply(cmd);
+                    setReply(done);
                 }
-                cmds_.pop_front();
             }
         }
     }
@@ -253,6 +696,7 @@ namespace redis
         XLOGF(INFO,"connect success thread[{}]", folly::getOSThreadID());
         cli_->setReadCB(this);
         cli_->setCloseOnExec();
+        applyOptions();
         reconnect_count_ = 0;
         reconnecting = false;
 
@@ -264,6 +708,23 @@ namespace redis
                 return shared->queryInternal(std::move(Command::Create(false).Auth(shared->pass_).Build()), false).unit();
             });
         }
+        resp_version_ = 2;
+        if(protocol_ == 3)
+        {
+            r = std::move(r).deferValue([shared = shared_from_this()](folly::Unit&&)
+            {
+                auto cmd = std::move(Command::Create(false).Hello(3).Build());
+                return shared->queryInternal(std::move(cmd), false).deferValue([shared](Reply&& rpl)
+                {
+                    if(rpl.IsError())
+                    {
+                        XLOGF(WARN,"redis [{}] HELLO 3 failed:{}, fall back to RESP2",shared->addr_.describe(),rpl.AsString());
+                        return;
+                    }
+                    shared->resp_version_ = 3;
+                });
+            });
+        }
         if(db_index_!=0 && !IsClusterConn())
         {
             r = std::move(r).deferValue([shared = shared_from_this()](folly::Unit&&)
@@ -273,23 +734,22 @@ namespace redis
             });
         }
         //TODO 直接重发吗??,有部分已经发送成功的话怎么处理????
+        if (!cmds_.empty())
         {
-            std::lock_guard<std::mutex> lock(cmds_mtx_);
-            if (!cmds_.empty())
+            r = std::move(r).deferValue([shared = shared_from_this()](folly::Unit&&)
             {
-                r = std::move(r).deferValue([shared = shared_from_this()](folly::Unit&&)
-                {
-                    folly::IOBufQueue buf(folly::IOBufQueue::cacheChainLength());
-                    for (auto& cmd : shared->cmds_) {
-                        for (auto& sub : cmd.cmds)
-                        {
-                            buf.append(sub.cmd.data(), sub.cmd.size());
-                        }
+                shared->dropExpired();
+                folly::IOBufQueue buf(folly::IOBufQueue::cacheChainLength());
+                for (std::size_t i = 0; i < shared->cmds_.size(); i++) {
+                    for (auto& sub : shared->cmds_[i].cmds)
+                    {
+                        buf.append(*sub.cmd, true);
                     }
-                    shared->Send(buf.move());
-                    return folly::makeSemiFuture();
-                });
-            }
+                }
+                if (!buf.empty())shared->Send(buf.move());
+                if (shared->waiting_ > 0)shared->wakeWaiters();
+                return folly::makeSemiFuture();
+            });
         }
 
         std::move(r).via(eventBase_).then([shared = shared_from_this()](folly::Try<folly::Unit>&& r)
@@ -301,23 +761,83 @@ namespace redis
             {
                 if(r.hasException())
                 {
-                    XLOG(ERR,"reconnect to redis[{}] error:{}", shared->addr_.getAddressStr(), r.exception().what());
+                    XLOG(ERR,"reconnect to redis[{}] error:{}", shared->addr_.describe(), r.exception().what());
                     shared->reconnect();
                 }
             }
         });
     }
+    folly::SocketOptionMap Conn::socketOptions() const
+    {
+        folly::SocketOptionMap opts;
+        if (addr_.getFamily() != AF_UNIX)
+        {
+            opts.emplace(folly::SocketOptionKey{ IPPROTO_TCP, TCP_NODELAY }, options_.tcp_nodelay ? 1 : 0);
+        }
+        if (options_.send_buffer > 0)
+        {
+            opts.emplace(folly::SocketOptionKey{ SOL_SOCKET, SO_SNDBUF }, options_.send_buffer);
+        }
+        if (options_.recv_buffer > 0)
+        {
+            opts.emplace(folly::SocketOptionKey{ SOL_SOCKET, SO_RCVBUF }, options_.recv_buffer);
+        }
+        return opts;
+    }
+    void Conn::applyOptions()
+    {
+        const bool tcp = addr_.getFamily() != AF_UNIX;
+        if (options_.busy_poll_us > 0)
+        {
+#ifdef SO_BUSY_POLL
+            if (cli_->setSockOpt(SOL_SOCKET, SO_BUSY_POLL, &options_.busy_poll_us) != 0)
+            {
+                XLOGF(WARN,"redis conn[{}] set SO_BUSY_POLL failed, errno:{}",addr_.describe(),errno);
+            }
+#else
+            XLOGF(WARN,"redis conn[{}] SO_BUSY_POLL is not supported",addr_.describe());
+#endif
+        }
+#ifdef TCP_QUICKACK
+        quick_ack_ = tcp && options_.quick_ack;
+#endif
+        rearmQuickAck();
+        //读回实际生效的值
+        eff_nodelay_ = tcp ? getSockOpt(IPPROTO_TCP, TCP_NODELAY) : -1;
+        eff_sndbuf_ = getSockOpt(SOL_SOCKET, SO_SNDBUF);
+        eff_rcvbuf_ = getSockOpt(SOL_SOCKET, SO_RCVBUF);
+#ifdef SO_BUSY_POLL
+        eff_busy_poll_ = getSockOpt(SOL_SOCKET, SO_BUSY_POLL);
+#endif
+#ifdef TCP_QUICKACK
+        eff_quick_ack_ = tcp ? getSockOpt(IPPROTO_TCP, TCP_QUICKACK) : -1;
+#endif
+    }
+    void Conn::rearmQuickAck()
+    {
+#ifdef TCP_QUICKACK
+        if (!quick_ack_ || !cli_)return;
+        const int one = 1;
+        cli_->setSockOpt(IPPROTO_TCP, TCP_QUICKACK, &one);
+#endif
+    }
+    int Conn::getSockOpt(int level, int name) const
+    {
+        int val = 0;
+        socklen_t len = sizeof(val);
+        return cli_->getSockOpt(level, name, &val, &len) == 0 ? val : -1;
+    }
     void Conn::connectErr(const folly::AsyncSocketException &ex) noexcept {
         if(!connectPromise_.isFulfilled()){
             connectPromise_.setException(ex);
         }else{
-            XLOGF(ERR,"connect to redis [{}] err:{},reconnect_count:{}",addr_.getAddressStr(),ex.what(),reconnect_count_);
+            XLOGF(ERR,"connect to redis [{}] err:{},reconnect_count:{}",addr_.describe(),ex.what(),reconnect_count_);
             reconnect();
         }
     }
     void Conn::readEOF() noexcept {
         if(cli_ && !cli_->isClosedBySelf()){
-            XLOGF(ERR,"redis conn[{}] lost!!,closed by server[{}]",addr_.getAddressStr(),cli_->isClosedByPeer());
+            XLOGF(ERR,"redis conn[{}] lost!!,closed by server[{}]",addr_.describe(),cli_->isClosedByPeer());
             reconnect();
         }
     }
@@ -327,21 +847,141 @@ namespace redis
     }
 
     void Conn::getReadBuffer(void **bufReturn, size_t *lenReturn) {
-        //TODO malloc
-        auto [buf,len] =buf_.preallocate(1024,1024);
+        //尾部剩余空间够一次最小读就继续用, 否则按当前读大小分配
+        auto [buf,len] =buf_.preallocate(kMinReadSize,read_size_);
         *bufReturn=buf;
         *lenReturn = len;
+        read_offered_ = len;
     }
     void Conn::readDataAvailable(size_t len) noexcept {
-        XLOGF(ERR,"redis conn readDataAvailablethread[{}]", folly::getOSThreadID());
+        XLOGF(DBG,"redis conn readDataAvailable thread[{}]", folly::getOSThreadID());
         buf_.postallocate(len);
-        while (builder_.Build());
-        while(builder_.IsReplyAvailable())
+        rearmQuickAck();
+        adjustReadSize(len, read_offered_);
+        parseReplies();
+    }
+    bool Conn::isBufferMovable() noexcept {
+        return movable_read_;
+    }
+    size_t Conn::maxBufferSize() const {
+        return read_size_;
+    }
+    void Conn::readBufferAvailable(std::unique_ptr<folly::IOBuf> readBuf) noexcept {
+        const auto len = readBuf->computeChainDataLength();
+        buf_.append(std::move(readBuf));
+        rearmQuickAck();
+        //AsyncSocket按maxBufferSize()分配
+        adjustReadSize(len, read_size_);
+        parseReplies();
+    }
+    void Conn::adjustReadSize(size_t len, size_t offered)
+    {
+        reads_ += 1;
+        bytes_read_ += len;
+        const auto size = read_size_.load(std::memory_order_relaxed);
+        if (len >= offered)
+        {
+            //读满了, 说明socket里还有数据; 只给了尾部剩余的一小块时读满不说明读大小不够
+            small_reads_ = 0;
+            if (offered >= size && size < kMaxReadSize)
+            {
+                read_size_ = size * 2;
+                read_grows_ += 1;
+            }
+        }
+        else if (len < size / 4)
+        {
+            if (++small_reads_ >= kShrinkAfterReads && size > kMinReadSize)
+            {
+                small_reads_ = 0;
+                read_size_ = size / 2;
+                read_shrinks_ += 1;
+            }
+        }
+        else
+        {
+            small_reads_ = 0;
+        }
+    }
+    ConnStats Conn::Stats() const
+    {
+        ConnStats stats;
+        stats.reads = reads_;
+        stats.bytes_read = bytes_read_;
+        stats.read_size = read_size_;
+        stats.read_grows = read_grows_;
+        stats.read_shrinks = read_shrinks_;
+        stats.read_buffered = read_buffered_;
+        stats.sends = sends_;
+        stats.writes = writes_;
+        stats.inflight = inflight_;
+        stats.timeouts = timeouts_;
+        stats.unsent_timeouts = unsent_timeouts_;
+        stats.inflight_bytes = inflight_bytes_;
+        stats.waiting = waiting_;
+        stats.waits = waits_;
+        stats.rejected = rejected_;
+        stats.tcp_nodelay = eff_nodelay_;
+        stats.send_buffer = eff_sndbuf_;
+        stats.recv_buffer = eff_rcvbuf_;
+        stats.busy_poll_us = eff_busy_poll_;
+        stats.quick_ack = eff_quick_ack_;
+        return stats;
+    }
+    void Conn::parseReplies() noexcept {
+        while (true)
+        {
+            //每个reply开始前确定它的读取方式
+            if (!builder_.InProgress())prepareReply();
+            try
+            {
+                if (!builder_.Build())break;
+            }
+            catch (const std::exception& ex)
+            {
+                //协议错误, 后面的数据都不可信了, 重连
+                XLOGF(ERR,"redis conn[{}] parse reply error:{}",addr_.describe(),ex.what());
+                builder_.Reset();
+                reconnect();
+                break;
+            }
+            OnReply(builder_.TakeFront());
+        }
+        read_buffered_ = buf_.chainLength();
+        if (!buf_.empty())return;
+        //读大小还没回到最小, 空闲一段时间后缩回去并释放读缓冲, 见shrinkIdle
+        if (read_size_ > kMinReadSize && !idle_shrink_.isScheduled())
+        {
+            idle_reads_ = reads_;
+            eventBase_->timer().scheduleTimeout(&idle_shrink_, kIdleShrinkDelay);
+        }
+    }
+    void Conn::IdleShrink::timeoutExpired() noexcept
+    {
+        conn_.shrinkIdle();
+    }
+    void Conn::shrinkIdle()
+    {
+        //计时期间又读到了数据, 不算空闲, 下次读缓冲排空时重新计时
+        if (reads_ != idle_reads_ || !buf_.empty())return;
+        read_size_ = kMinReadSize;
+        small_reads_ = 0;
+        read_shrinks_ += 1;
+        buf_.move();
+    }
+    void Conn::prepareReply()
+    {
+        ChunkCallback cb;
+        ReplyVisitor* visitor = nullptr;
+        //超时的命令不再回调, 回包按普通的Reply解析后丢弃
+        if (custom_cmds_ != 0 && !cmds_.empty() && !cmds_.front().expired)
         {
-            auto rpy = builder_.GetFront();
-            OnReply(std::move(rpy));
-            builder_.PopFront();
+            cb = cmds_.front().chunk_cb;
+            //WaitingCommand持有visitor, reply解析完之前不会出队
+            visitor = cmds_.front().visitor.get();
         }
+        builder_.SetChunkCallback(std::move(cb));
+        builder_.SetVisitor(visitor);
     }
     void Conn::writeSuccess() noexcept {
     }
@@ -364,9 +1004,10 @@ namespace redis
                 shared->reconnect_count_+=1;
                 shared->cli_->getEventBase()->runInEventBaseThread([shared]{
                     auto evt = shared->cli_->getEventBase();
+                    shared->dropPendingWrites();
                     shared->cli_.reset();
                     shared->cli_=folly::AsyncSocket::newSocket(evt);
-                    shared->cli_->connect(shared.get(),shared->addr_,shared->timeout_ms_);
+                    shared->cli_->connect(shared.get(),shared->addr_,shared->timeout_ms_,shared->socketOptions());
                 });
            });
         }else
@@ -375,9 +1016,10 @@ namespace redis
             reconnecting=true;
             cli_->getEventBase()->runInEventBaseThread([shared=shared_from_this()]{
                 auto evt = shared->cli_->getEventBase();
+                shared->dropPendingWrites();
                 shared->cli_.reset();
                 shared->cli_=folly::AsyncSocket::newSocket(evt);
-                shared->cli_->connect(shared.get(),shared->addr_,shared->timeout_ms_);
+                shared->cli_->connect(shared.get(),shared->addr_,shared->timeout_ms_,shared->socketOptions());
             });
         }
     }
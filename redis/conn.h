@@ -1,16 +1,69 @@
 #pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <functional>
-#include <mutex>
+#include <stdexcept>
 
+#include <folly/concurrency/UnboundedQueue.h>
 #include <folly/futures/Future.h>
 #include <folly/io/async/AsyncSocket.h>
+#include <folly/io/async/HHWheelTimer.h>
 
 #include "redis/command.h"
 #include "redis/builders.h"
+#include "redis/slot_ring.h"
 
 namespace redis
 {
     class ClusterConns;
+    //连接的统计信息, 见Conn::Stats
+    struct ConnStats
+    {
+        uint64_t reads{ 0 };            //读回调次数
+        uint64_t bytes_read{ 0 };       //读到的字节数
+        std::size_t read_size{ 0 };     //当前每次读的大小
+        uint64_t read_grows{ 0 };       //读大小翻倍的次数
+        uint64_t read_shrinks{ 0 };     //读大小缩小的次数(减半或者空闲时缩回最小)
+        std::size_t read_buffered{ 0 }; //读缓冲中还没解析完的字节数
+        uint64_t sends{ 0 };            //提交发送的命令(或pipeline)个数
+        uint64_t writes{ 0 };           //writeChain次数, 自动pipeline时多个命令合并成一次
+        std::size_t inflight{ 0 };      //已提交还没收到全部回包的命令(或pipeline)个数
+        uint64_t timeouts{ 0 };         //超时的命令个数
+        uint64_t unsent_timeouts{ 0 };  //其中超时时还没写出, 直接丢弃的个数
+        std::size_t inflight_bytes{ 0 };//未完成的命令序列化后的字节数
+        std::size_t waiting{ 0 };       //正在等待空位的提交个数
+        uint64_t waits{ 0 };            //超过上限后等待空位的次数
+        uint64_t rejected{ 0 };         //超过上限被拒绝的命令个数
+        //实际生效的socket选项, 连接时从socket读回; -1表示没有连上或者不适用(unix socket没有TCP选项)
+        int tcp_nodelay{ -1 };
+        int send_buffer{ -1 };          //内核会调整设置的值(Linux是两倍)
+        int recv_buffer{ -1 };
+        int busy_poll_us{ -1 };
+        int quick_ack{ -1 };
+    };
+    //socket选项, 连接和重连时设置, 见Conn::Connect
+    struct ConnOptions
+    {
+        bool tcp_nodelay{ true };       //关闭Nagle, 小命令不等凑包
+        int send_buffer{ 0 };           //SO_SNDBUF, 0表示系统默认
+        int recv_buffer{ 0 };           //SO_RCVBUF, 0表示系统默认
+        int busy_poll_us{ 0 };          //SO_BUSY_POLL的微秒数, 0表示不设置; 超过net.core.busy_read需要CAP_NET_ADMIN
+        bool quick_ack{ false };        //TCP_QUICKACK, 内核会自动清掉, 每次读之后重新设置, 多一次系统调用
+    };
+    //连接的背压设置, 见Conn::SetLimits
+    struct ConnLimits
+    {
+        std::size_t max_inflight{ 0 };          //未完成的命令(或pipeline)个数上限, 0表示不限制
+        std::size_t max_inflight_bytes{ 0 };    //未完成的命令序列化后的字节数上限, 0表示不限制
+        bool wait{ false };                     //超过上限时: false立即返回ConnOverloaded异常, true等待有空位再提交
+    };
+    //超过ConnLimits的上限时返回的异常
+    class ConnOverloaded : public std::runtime_error
+    {
+    public:
+        ConnOverloaded() : std::runtime_error( "redis conn is overloaded" ) {}
+    };
     class Conn:
             folly::AsyncSocket::ConnectCallback,
             folly::AsyncReader::ReadCallback,
@@ -24,12 +77,63 @@ namespace redis
             SUBSCRIBER  =4, //订阅链接
         };
     private:
+        //命令的超时定时器, 在IO线程的HHWheelTimer上, 连接内复用
+        struct Deadline : folly::HHWheelTimer::Callback
+        {
+            explicit Deadline(Conn& conn) : conn_(conn) {}
+            void timeoutExpired() noexcept override;
+            Conn& conn_;
+            //命令的序号, 在cmds_中的下标是seq - cmds_seq_
+            uint64_t seq{ 0 };
+        };
+        //定时器用完取消后还回连接的空闲列表, 见acquireTimer
+        struct DeadlineRelease
+        {
+            void operator()(Deadline* timer) const noexcept;
+        };
+        using DeadlinePtr = std::unique_ptr<Deadline, DeadlineRelease>;
+        //读缓冲空闲的定时器, 到期时读大小缩回最小, 见parseReplies
+        struct IdleShrink : folly::HHWheelTimer::Callback
+        {
+            explicit IdleShrink(Conn& conn) : conn_(conn) {}
+            void timeoutExpired() noexcept override;
+            Conn& conn_;
+        };
         struct WaitingCommand
         {
-            std::vector<CommandVal> cmds;
-            folly::Promise<Reply> reply;
+            CommandList cmds;
+            //Run()的命令不需要结果, 默认是空的promise, 不分配
+            folly::Promise<Reply> reply{ folly::Promise<Reply>::makeEmpty() };
             bool ignore{ false };
             bool pipeline{ false };
+            //流式读取的命令, 只能有一个子命令
+            ChunkCallback chunk_cb;
+            //直接解析回包的命令, 只能有一个子命令
+            std::shared_ptr<ReplyVisitor> visitor;
+            //截止时间, 没有超时的命令是默认值
+            std::chrono::steady_clock::time_point deadline;
+            //进入cmds_时在IO线程设置
+            DeadlinePtr timer;
+            //已经超时, promise已经设置了异常, 回包到达时丢弃
+            bool expired{ false };
+            //序列化后的字节数, 计入inflight_bytes_
+            std::size_t bytes{ 0 };
+            //在写队列中的字节数和当时写队列的代数, 代数和write_gen_相同说明还没写出
+            std::size_t wire_bytes{ 0 };
+            uint64_t write_gen{ 0 };
+        };
+        //其他线程提交的命令
+        struct Submission
+        {
+            WaitingCommand cmd;
+            bool append{ true };
+        };
+        //等待空位的提交, 放行时直接提交; WaitCapacity()的等待者没有命令, 放行时完成ready
+        struct Waiter
+        {
+            WaitingCommand cmd;
+            bool has_cmd{ false };
+            folly::Promise<folly::Unit> ready{ folly::Promise<folly::Unit>::makeEmpty() };
         };
     public:
         using ConnectCallback = std::function<folly::SemiFuture<folly::Unit>(Conn& )>;
@@ -39,8 +143,10 @@ namespace redis
         explicit Conn(const Flag flag) : flags_(flag) {}
         explicit Conn(const std::shared_ptr<ClusterConns>& cluster): flags_(CLUSTER), cluster_(cluster){}
         ~Conn()override;
-        //连接
-        folly::SemiFuture<folly::Unit> Connect( const std::string& host, int port,std::string pass="",int32_t db=0, int32_t timeout_ms = 0);
+        //连接, host是以'/'开头的路径时连接unix domain socket(如/var/run/redis.sock), 忽略port
+        folly::SemiFuture<folly::Unit> Connect( const std::string& host, int port,std::string pass="",int32_t db=0, int32_t timeout_ms = 0,
+            const ConnOptions& options = ConnOptions() );
+        static bool IsUnixPath( const std::string& host ) { return !host.empty() && host[0] == '/'; }
         //断开
         void Close();
         //判断是否连接
@@ -59,11 +165,67 @@ namespace redis
         {
             reply_cb_ = std::move( cb );
         }
+        //RESP3的push消息(客户端缓存失效通知等), 在IO线程回调
+        void SetPushCallback( const ReplyCallback& cb )
+        {
+            push_cb_ = cb;
+        }
+        void SetPushCallback( ReplyCallback&& cb )
+        {
+            push_cb_ = std::move( cb );
+        }
+        //连接前设置, 3表示连接后发送HELLO 3, 服务器不支持时回退到2
+        void SetProtocol( int protover ) { protocol_ = protover; }
+        //实际协商的协议版本
+        int Protocol() const { return resp_version_; }
+        //连接前设置, 聚合类型的回包整棵树从一个arena分配, 见ReplyBuilder::SetArena
+        void SetReplyArena( bool enable ) { builder_.SetArena( enable ); }
+        //连接前设置, 由AsyncSocket分配读缓冲后整块交给连接(isBufferMovable), 大的回包直接落在IOBuf里
+        void SetMovableReadBuffer( bool enable ) { movable_read_ = enable; }
+        /**
+         * 连接前设置, 自动pipeline: 任意线程提交的命令先进写队列, 每次事件循环合并成一次writeChain
+         * 在IO线程提交时, 积压超过max_bytes字节或者max_cmds个命令立即写出
+         */
+        void SetAutoPipeline( bool enable, std::size_t max_bytes = kAutoPipelineBytes, std::size_t max_cmds = kAutoPipelineCmds )
+        {
+            auto_pipeline_ = enable;
+            pipeline_bytes_ = max_bytes;
+            pipeline_cmds_ = max_cmds;
+        }
+        /**
+         * 连接前设置, 连接后修改不是线程安全的
+         * 背压: 未完成的命令个数或者字节数超过上限时拒绝或者等待, 防止服务器卡住时无限堆积
+         * 命令在收到回包前一直留在连接里(断线重连要重发), 所以字节数从提交算到收到回包
+         * 上限在提交的线程检查, 多个线程同时提交时可能略微超出
+         * 等待的提交按先后顺序放行, 有提交在等待时新的提交也排到后面, 截止时间包括等待的时间
+         */
+        void SetLimits( const ConnLimits& limits ) { limits_ = limits; }
+        const ConnLimits& Limits() const { return limits_; }
+        //是否已经达到上限, 任意线程可调用
+        bool Overloaded() const;
+        //有空位时完成, 异步的提交者可以等它再提交; 没有达到上限时立即完成
+        folly::SemiFuture<folly::Unit> WaitCapacity();
+        ConnStats Stats() const;
+        //已提交还没完成的命令个数, 任意线程可读, 连接池用来选连接
+        std::size_t Inflight() const { return inflight_.load( std::memory_order_relaxed ); }
         const folly::SocketAddress& Addr()const { return addr_; }
         folly::Executor::KeepAlive<folly::EventBase> GetEventBase()const{return eventBase_;}
     public:
         folly::SemiFuture<Reply> Query(Command cmd);
+        /**
+         * 流式读取大的bulk string(GET/DUMP等), payload不在读缓冲中堆积, 每到一段就在IO线程回调cb
+         * 返回的reply是空的bulk string; 如果回包不是bulk string(nil,错误等)则原样返回
+         */
+        folly::SemiFuture<Reply> QueryStream(Command cmd, ChunkCallback cb);
+        /**
+         * 回包数据还在读缓冲中时就在IO线程交给visitor, 不构造Reply树, 只能有一个命令
+         * 返回的reply是Null占位; 顶层的错误不回调visitor, 原样返回
+         */
+        folly::SemiFuture<Reply> QueryVisit(Command cmd, std::shared_ptr<ReplyVisitor> visitor);
         void Run(Command cmd);
+        //PreparedCommand绑定好的单条命令, 不经过Command
+        folly::SemiFuture<Reply> QueryPrepared(std::unique_ptr<folly::IOBuf> cmd);
+        void RunPrepared(std::unique_ptr<folly::IOBuf> cmd);
     private:
         void connectSuccess() noexcept override;
         void connectErr(const folly::AsyncSocketException &ex) noexcept override;
@@ -72,32 +234,155 @@ namespace redis
         void readErr(const folly::AsyncSocketException &ex) noexcept override;
         void getReadBuffer(void **bufReturn, size_t *lenReturn) override;
         void readDataAvailable(size_t len) noexcept override;
+        bool isBufferMovable() noexcept override;
+        size_t maxBufferSize() const override;
+        void readBufferAvailable(std::unique_ptr<folly::IOBuf> readBuf) noexcept override;
+        //根据这次读到的字节数和给出的缓冲大小调整下次读的大小
+        void adjustReadSize(size_t len, size_t offered);
+        //空闲了一段时间, 读大小缩回最小并释放读缓冲
+        void shrinkIdle();
+        //解析读缓冲中所有完整的回包
+        void parseReplies() noexcept;
+        //自动pipeline: 安排在这轮事件循环结束时写出, now为true时立即写出
+        void scheduleFlush(bool now);
+        //写出写队列中的所有数据
+        void flushWrites();
+        //断线后丢弃写队列, 重连成功后cmds_会整体重发
+        void dropPendingWrites();
+        //写出前去掉写队列中已经超时的命令
+        void dropUnsentExpired();
 
         void writeSuccess() noexcept override;
         void writeErr(size_t bytesWritten, const folly::AsyncSocketException &ex) noexcept override;
 
         void reconnect();
+        //连接前设置的socket选项, 缓冲大小要在connect前设置才影响窗口
+        folly::SocketOptionMap socketOptions() const;
+        //连接后设置的socket选项(失败只打日志), 并读回实际生效的值
+        void applyOptions();
+        void rearmQuickAck();
+        int getSockOpt(int level, int name) const;
         folly::SemiFuture<Reply> queryInternal(Command cmd, bool append = true);
+        //任意线程提交命令, 不在IO线程时经submissions_转交
         void run(WaitingCommand&& cmd,bool append=true);
+        //取出其他线程提交的所有命令
+        void drainSubmissions();
+        //命令进入cmds_, 已连接时序列化到写队列
+        void enqueue(WaitingCommand&& cmd, bool append);
+        //cmds_入队出队, 同时维护定时器中的序号
+        void pushCommand(WaitingCommand&& cmd, bool append);
+        void popCommand();
+        //按Command的超时设置截止时间
+        static void setDeadline(WaitingCommand& wait, const Command& cmd);
+        //命令进入cmds_前设置定时器, 已经超时返回false
+        bool armDeadline(WaitingCommand& cmd);
+        //从空闲列表取一个定时器, 没有再分配
+        DeadlinePtr acquireTimer();
+        //定时器到期, 让对应的命令超时
+        void expire(Deadline* timer);
+        //重连后重发前, 去掉cmds_中已经超时的命令
+        void dropExpired();
+        //达到上限时按设置拒绝或者排队, 排队模式下已经有提交在等待也要排队; 返回true表示可以直接提交
+        bool admit(WaitingCommand& cmd);
+        //任意线程加入等待队列
+        void addWaiter(Waiter&& waiter);
+        //命令完成或者丢弃, 还回占用的位置, 调用前命令要先出队
+        void release(std::size_t bytes);
+        //IO线程按顺序放行等待空位的提交
+        void wakeWaiters();
         void OnReply(Reply&& rpl);
+        //按下一个回包对应的命令设置流式回调和visitor
+        void prepareReply();
         bool hasRedirectError(WaitingCommand& cmd);
         bool hasMovedError(WaitingCommand& cmd);
         void redirect(WaitingCommand&& cmd);
         void setReply(WaitingCommand& cmd);
     private:
         ReplyCallback reply_cb_;
+        ReplyCallback push_cb_;
+        int protocol_{2};
+        std::atomic<int> resp_version_{2};
 
         /***********************reply****************************************/
         folly::IOBufQueue buf_{ folly::IOBufQueue::cacheChainLength() };
         ReplyBuilder builder_{buf_};
+        //每次读的大小范围
+        static constexpr std::size_t kMinReadSize = 4096;
+        static constexpr std::size_t kMaxReadSize = 256 * 1024;
+        //连续这么多次读到的不足1/4就减半
+        static constexpr uint32_t kShrinkAfterReads = 16;
+        //读缓冲排空后这么久没有读到数据, 读大小缩回最小
+        static constexpr std::chrono::milliseconds kIdleShrinkDelay{1000};
+        bool movable_read_{false};
+        //每次读的大小, 读满了翻倍, 连续读得很少减半, 空闲时缩回最小
+        std::atomic<std::size_t> read_size_{kMinReadSize};
+        //上次getReadBuffer实际给出的大小, 尾部剩余的空间可能比read_size_小
+        std::size_t read_offered_{0};
+        uint32_t small_reads_{0};
+        IdleShrink idle_shrink_{*this};
+        //开始空闲计时时的reads_
+        uint64_t idle_reads_{0};
+        std::atomic<uint64_t> reads_{0};
+        std::atomic<uint64_t> bytes_read_{0};
+        std::atomic<uint64_t> read_grows_{0};
+        std::atomic<uint64_t> read_shrinks_{0};
+        std::atomic<std::size_t> read_buffered_{0};
+
+        //自动pipeline的默认阈值
+        static constexpr std::size_t kAutoPipelineBytes = 64 * 1024;
+        static constexpr std::size_t kAutoPipelineCmds = 1024;
+        bool auto_pipeline_{false};
+        std::size_t pipeline_bytes_{kAutoPipelineBytes};
+        std::size_t pipeline_cmds_{kAutoPipelineCmds};
+        std::atomic<uint64_t> sends_{0};
+        std::atomic<uint64_t> writes_{0};
+        std::atomic<std::size_t> inflight_{0};
+        std::atomic<uint64_t> timeouts_{0};
+        std::atomic<uint64_t> unsent_timeouts_{0};
+        //背压
+        ConnLimits limits_;
+        std::atomic<std::size_t> inflight_bytes_{0};
+        folly::UMPSCQueue<Waiter, false> waiters_;
+        std::atomic<std::size_t> waiting_{0};
+        std::atomic<uint64_t> waits_{0};
+        std::atomic<uint64_t> rejected_{0};
+
+        /**
+         * 其他线程提交的命令进入无锁的submissions_, 由IO线程取出
+         * 下面的成员都只在IO线程访问
+         */
+        folly::UMPSCQueue<Submission, false> submissions_;
+        std::atomic_bool drain_scheduled_{false};
+        //等待写出的数据, 顺序和cmds_一致
+        folly::IOBufQueue pending_writes_{ folly::IOBufQueue::cacheChainLength() };
+        std::size_t pending_cmds_{0};
+        //写队列的代数, 每次写出或者丢弃写队列加一
+        uint64_t write_gen_{0};
+        //写队列中已经超时的命令个数
+        std::size_t pending_expired_{0};
+        bool flush_scheduled_{false};
 
-        std::mutex                                  cmds_mtx_;
-        std::deque<WaitingCommand>                 cmds_;  // 等待中的命令列表
+        //空闲的定时器, 要在cmds_之后析构; 超过上限的直接释放
+        static constexpr std::size_t kMaxFreeTimers = 1024;
+        std::vector<std::unique_ptr<Deadline>> free_timers_;
+        //等待中的命令列表的初始容量
+        static constexpr std::size_t kInflightSlots = 64;
+        SlotRing<WaitingCommand>                   cmds_{kInflightSlots};  // 等待回包的命令列表, 槽位复用
+        uint64_t                                   cmds_seq_{0};    // cmds_队头命令的序号, cmds_[i]的序号是cmds_seq_ + i
+        int                                        custom_cmds_{0}; // cmds_中流式读取或者直接解析的命令个数
         /***********************connect info********************************/
         folly::SocketAddress addr_;
         std::string pass_;
         int32_t     db_index_{0};
         int32_t timeout_ms_{2000}; //连接超时
+        ConnOptions options_;
+        bool quick_ack_{false};     //tcp连接并且设置了quick_ack
+        //实际生效的socket选项, 见ConnStats
+        std::atomic<int> eff_nodelay_{-1};
+        std::atomic<int> eff_sndbuf_{-1};
+        std::atomic<int> eff_rcvbuf_{-1};
+        std::atomic<int> eff_busy_poll_{-1};
+        std::atomic<int> eff_quick_ack_{-1};
         int32_t flags_{SINGLE};
         std::atomic_bool closing{false};
         std::atomic_bool reconnecting{false};
@@ -0,0 +1,371 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <exception>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <folly/Conv.h>
+#include <folly/Range.h>
+
+#include "redis/builders.h"
+/**
+ * 把回包直接解析成目标类型, 不经过Reply树(TypedVisitor), 或者从已有的Reply树转换(FromReply)
+ * 支持: 整数, 浮点, bool, std::string, std::optional<T>, std::vector<T>, std::map<K,V>, std::unordered_map<K,V>
+ * nil只能解析到std::optional, nil数组解析成空的容器
+ */
+namespace redis::decode
+{
+    //解析事件
+    struct Event
+    {
+        enum class Kind
+        {
+            ArrayBegin,
+            ArrayEnd,
+            String,
+            Integer,
+            Double,
+            Boolean,
+            Null,
+        };
+        Kind kind;
+        folly::StringPiece str{};
+        int64_t num{ 0 };
+        double dbl{ 0 };
+    };
+
+    [[noreturn]] inline void Unexpected( const Event& e )
+    {
+        switch ( e.kind )
+        {
+        case Event::Kind::Null:
+            throw std::runtime_error( "unexpected nil reply, decode into std::optional" );
+        case Event::Kind::ArrayBegin:
+        case Event::Kind::ArrayEnd:
+            throw std::runtime_error( "unexpected array reply" );
+        default:
+            throw std::runtime_error( "unexpected reply type" );
+        }
+    }
+
+    //数组预分配上限
+    constexpr int64_t MAX_DECODE_RESERVE = 1 << 16;
+
+    template <class C, class = void>
+    struct HasReserve : std::false_type {};
+    template <class C>
+    struct HasReserve<C, std::void_t<decltype( std::declval<C&>().reserve( 0 ) )>> : std::true_type {};
+
+    /**
+     * Decoder<T>::feed 接收一个事件, 值完整时返回true, 结果在value中
+     */
+    template <class T, class Enable = void>
+    struct Decoder;
+
+    template <class T>
+    struct Decoder<T, std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool>>>
+    {
+        T value{};
+        bool feed( const Event& e )
+        {
+            switch ( e.kind )
+            {
+            case Event::Kind::Integer:
+            case Event::Kind::Boolean:
+                value = folly::to<T>( e.num );
+                return true;
+            case Event::Kind::String:
+                value = folly::to<T>( e.str );
+                return true;
+            default:
+                Unexpected( e );
+            }
+        }
+    };
+
+    template <class T>
+    struct Decoder<T, std::enable_if_t<std::is_floating_point_v<T>>>
+    {
+        T value{};
+        bool feed( const Event& e )
+        {
+            switch ( e.kind )
+            {
+            case Event::Kind::Double:
+                value = static_cast<T>( e.dbl );
+                return true;
+            case Event::Kind::Integer:
+                value = static_cast<T>( e.num );
+                return true;
+            case Event::Kind::String:
+                value = folly::to<T>( e.str );
+                return true;
+            default:
+                Unexpected( e );
+            }
+        }
+    };
+
+    template <>
+    struct Decoder<bool>
+    {
+        bool value{ false };
+        bool feed( const Event& e )
+        {
+            switch ( e.kind )
+            {
+            case Event::Kind::Integer:
+            case Event::Kind::Boolean:
+                value = e.num != 0;
+                return true;
+            case Event::Kind::String:
+                value = folly::to<bool>( e.str );
+                return true;
+            default:
+                Unexpected( e );
+            }
+        }
+    };
+
+    template <>
+    struct Decoder<std::string>
+    {
+        std::string value;
+        bool feed( const Event& e )
+        {
+            switch ( e.kind )
+            {
+            case Event::Kind::String:
+                value.assign( e.str.data(), e.str.size() );
+                return true;
+            case Event::Kind::Integer:
+                value = folly::to<std::string>( e.num );
+                return true;
+            case Event::Kind::Double:
+                value = folly::to<std::string>( e.dbl );
+                return true;
+            default:
+                Unexpected( e );
+            }
+        }
+    };
+
+    template <class T>
+    struct Decoder<std::optional<T>>
+    {
+        std::optional<T> value;
+        bool feed( const Event& e )
+        {
+            if ( !inner_ ) {
+                if ( e.kind == Event::Kind::Null ) {
+                    value.reset();
+                    return true;
+                }
+                inner_.emplace();
+            }
+            if ( !inner_->feed( e ) )return false;
+            value = std::move( inner_->value );
+            inner_.reset();
+            return true;
+        }
+    private:
+        std::optional<Decoder<T>> inner_;
+    };
+
+    template <class T, class A>
+    struct Decoder<std::vector<T, A>>
+    {
+        std::vector<T, A> value;
+        bool feed( const Event& e )
+        {
+            if ( !started_ ) {
+                if ( e.kind == Event::Kind::Null )return true;
+                if ( e.kind != Event::Kind::ArrayBegin )Unexpected( e );
+                started_ = true;
+                value.reserve( static_cast<std::size_t>( std::min( e.num, MAX_DECODE_RESERVE ) ) );
+                return false;
+            }
+            if ( !in_elem_ && e.kind == Event::Kind::ArrayEnd ) {
+                started_ = false;
+                return true;
+            }
+            in_elem_ = !elem_.feed( e );
+            if ( !in_elem_ ) {
+                value.push_back( std::move( elem_.value ) );
+                elem_ = Decoder<T>();
+            }
+            return false;
+        }
+    private:
+        Decoder<T> elem_;
+        bool started_{ false };
+        //元素本身是聚合类型, 还没结束
+        bool in_elem_{ false };
+    };
+
+    //RESP2的平铺数组[k1,v1,k2,v2...]和RESP3的map都可以
+    template <class Map>
+    struct MapDecoder
+    {
+        using K = typename Map::key_type;
+        using V = typename Map::mapped_type;
+        Map value;
+        bool feed( const Event& e )
+        {
+            if ( !started_ ) {
+                if ( e.kind == Event::Kind::Null )return true;
+                if ( e.kind != Event::Kind::ArrayBegin )Unexpected( e );
+                started_ = true;
+                if constexpr ( HasReserve<Map>::value ) {
+                    value.reserve( static_cast<std::size_t>( std::min( e.num / 2, MAX_DECODE_RESERVE ) ) );
+                }
+                return false;
+            }
+            if ( !in_child_ && e.kind == Event::Kind::ArrayEnd ) {
+                started_ = false;
+                return true;
+            }
+            if ( !has_key_ ) {
+                in_child_ = !key_.feed( e );
+                has_key_ = !in_child_;
+                return false;
+            }
+            in_child_ = !val_.feed( e );
+            if ( !in_child_ ) {
+                value.insert_or_assign( std::move( key_.value ), std::move( val_.value ) );
+                key_ = Decoder<K>();
+                val_ = Decoder<V>();
+                has_key_ = false;
+            }
+            return false;
+        }
+    private:
+        Decoder<K> key_;
+        Decoder<V> val_;
+        bool started_{ false };
+        bool in_child_{ false };
+        bool has_key_{ false };
+    };
+
+    template <class K, class V, class C, class A>
+    struct Decoder<std::map<K, V, C, A>> : MapDecoder<std::map<K, V, C, A>> {};
+
+    template <class K, class V, class H, class E, class A>
+    struct Decoder<std::unordered_map<K, V, H, E, A>> : MapDecoder<std::unordered_map<K, V, H, E, A>> {};
+
+    namespace detail
+    {
+        //按解析时的顺序把Reply树重放成事件, 返回最后一个事件的feed结果
+        template <class D>
+        bool replay( D& decoder, const Reply& rpl )
+        {
+            switch ( rpl.GetType() )
+            {
+            case Reply::Type::Null:
+                return decoder.feed( { Event::Kind::Null } );
+            case Reply::Type::Integer:
+                return decoder.feed( { Event::Kind::Integer, {}, rpl.AsInteger() } );
+            case Reply::Type::Double:
+                return decoder.feed( { Event::Kind::Double, {}, 0, rpl.AsDouble() } );
+            case Reply::Type::Boolean:
+                return decoder.feed( { Event::Kind::Boolean, {}, rpl.AsBool() ? 1 : 0 } );
+            case Reply::Type::Array:
+            case Reply::Type::Map:
+            case Reply::Type::Set:
+            case Reply::Type::Push:
+            {
+                const auto rows = rpl.Rows();
+                if ( decoder.feed( { Event::Kind::ArrayBegin, {}, static_cast<int64_t>( rows.size() ) } ) )return true;
+                for ( auto& row : rows ) {
+                    replay( decoder, row );
+                }
+                return decoder.feed( { Event::Kind::ArrayEnd } );
+            }
+            case Reply::Type::Error:
+            case Reply::Type::MovedError:
+            case Reply::Type::AskError:
+                throw std::runtime_error( rpl.AsString() );
+            default:
+                return decoder.feed( { Event::Kind::String, rpl.AsStringPiece() } );
+            }
+        }
+    }
+
+    /**
+     * 把已经构造好的Reply解析成T, 如Pipeline()的结果逐个转换
+     * 回包(包括数组中)是错误或者类型不匹配时抛std::runtime_error
+     */
+    template <class T>
+    T FromReply( const Reply& rpl )
+    {
+        Decoder<T> decoder;
+        if ( !detail::replay( decoder, rpl ) )throw std::runtime_error( "incomplete reply" );
+        return std::move( decoder.value );
+    }
+
+    /**
+     * 把ReplyVisitor的回调转成Decoder<T>的事件
+     * 解析失败时记下异常, 剩下的数据继续由解析器消费, 连接不受影响
+     */
+    template <class T>
+    class TypedVisitor : public ReplyVisitor
+    {
+    public:
+        void onArrayBegin( int64_t n, Reply::Type ) override {
+            feed( { Event::Kind::ArrayBegin, {}, n } );
+        }
+        void onArrayEnd() override {
+            feed( { Event::Kind::ArrayEnd } );
+        }
+        void onBulk( folly::StringPiece str ) override {
+            feed( { Event::Kind::String, str } );
+        }
+        void onInt( int64_t val ) override {
+            feed( { Event::Kind::Integer, {}, val } );
+        }
+        void onDouble( double val ) override {
+            feed( { Event::Kind::Double, {}, 0, val } );
+        }
+        void onBool( bool val ) override {
+            feed( { Event::Kind::Boolean, {}, val ? 1 : 0 } );
+        }
+        void onNull() override {
+            feed( { Event::Kind::Null } );
+        }
+        void onError( folly::StringPiece err ) override {
+            if ( !error_ )error_ = std::make_exception_ptr( std::runtime_error( err.str() ) );
+        }
+    public:
+        //取出结果, 解析失败或者数据不完整时抛异常
+        T Result()
+        {
+            if ( error_ )std::rethrow_exception( error_ );
+            if ( !done_ )throw std::runtime_error( "incomplete reply" );
+            return std::move( decoder_.value );
+        }
+    private:
+        void feed( const Event& e ) noexcept
+        {
+            if ( error_ || done_ )return;
+            try
+            {
+                done_ = decoder_.feed( e );
+            }
+            catch ( ... )
+            {
+                error_ = std::current_exception();
+            }
+        }
+    private:
+        Decoder<T> decoder_;
+        bool done_{ false };
+        std::exception_ptr error_;
+    };
+}
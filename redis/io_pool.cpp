@@ -0,0 +1,102 @@
+#include "redis/io_pool.h"
+
+#include <algorithm>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#include <folly/executors/GlobalExecutor.h>
+#include <folly/executors/IOThreadPoolExecutor.h>
+#include <folly/executors/thread_factory/NamedThreadFactory.h>
+#include <folly/io/async/EventBaseManager.h>
+
+//IoUringBackend的位置在不同版本的folly里不一样
+#if __has_include(<folly/io/async/IoUringBackend.h>)
+#include <folly/io/async/IoUringBackend.h>
+#elif __has_include(<folly/experimental/io/IoUringBackend.h>)
+#include <folly/experimental/io/IoUringBackend.h>
+#endif
+
+#if defined(FOLLY_HAS_LIBURING) && FOLLY_HAS_LIBURING
+#define REDIS_HAS_IO_URING 1
+#else
+#define REDIS_HAS_IO_URING 0
+#endif
+
+namespace redis
+{
+    namespace
+    {
+        //线程池要先于它的EventBaseManager销毁, 连接通过别名shared_ptr持有整个结构
+        struct IOPool
+        {
+            std::unique_ptr<folly::EventBaseManager> ebm;
+            std::unique_ptr<folly::IOThreadPoolExecutor> exec;
+        };
+
+        std::mutex pool_mtx;
+        std::shared_ptr<folly::IOExecutor> current_pool;
+
+#if REDIS_HAS_IO_URING
+        folly::EventBase::Options ioUringOptions(const IOPoolOptions& options)
+        {
+            folly::IoUringBackend::Options backend;
+            backend.setCapacity(options.capacity)
+                .setMaxSubmit(options.max_submit)
+                .setMaxGet(options.max_get);
+            return folly::EventBase::Options().setBackendFactory([backend]
+            {
+                return std::make_unique<folly::IoUringBackend>(backend);
+            });
+        }
+#endif
+    }
+
+    bool IoUringAvailable()
+    {
+#if REDIS_HAS_IO_URING
+        return folly::IoUringBackend::isAvailable();
+#else
+        return false;
+#endif
+    }
+
+    std::shared_ptr<folly::IOExecutor> MakeIOPool(const IOPoolOptions& options)
+    {
+        auto pool = std::make_shared<IOPool>();
+        if (options.backend == IOBackend::IoUring)
+        {
+            if (!IoUringAvailable()) {
+                throw std::runtime_error("io_uring is not available");
+            }
+#if REDIS_HAS_IO_URING
+            pool->ebm = std::make_unique<folly::EventBaseManager>(ioUringOptions(options));
+#endif
+        }
+        else
+        {
+            pool->ebm = std::make_unique<folly::EventBaseManager>();
+        }
+        const auto threads = options.threads != 0 ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+        pool->exec = std::make_unique<folly::IOThreadPoolExecutor>(threads,
+            std::make_shared<folly::NamedThreadFactory>(options.backend == IOBackend::IoUring ? "RedisIoUring" : "RedisEpoll"),
+            pool->ebm.get());
+        return std::shared_ptr<folly::IOExecutor>(pool, pool->exec.get());
+    }
+
+    void SetIOPool(std::shared_ptr<folly::IOExecutor> pool)
+    {
+        std::lock_guard<std::mutex> lock(pool_mtx);
+        current_pool = std::move(pool);
+    }
+
+    std::shared_ptr<folly::IOExecutor> GetIOPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(pool_mtx);
+            if (current_pool)return current_pool;
+        }
+        //getGlobalIOExecutor()返回的是KeepAlive
+        return folly::getUnsafeMutableGlobalIOExecutor();
+    }
+}
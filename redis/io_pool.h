@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include <folly/executors/IOExecutor.h>
+
+#include "redis/redis_export.h"
+namespace redis
+{
+    //IO线程上事件循环的后端
+    enum class IOBackend
+    {
+        Epoll,      //folly默认的epoll
+        IoUring,    //folly的IoUringBackend, 需要编译folly时有liburing, 内核5.1以上
+    };
+    //专用IO线程池的设置, 见MakeIOPool
+    struct IOPoolOptions
+    {
+        //默认epoll; io_uring要显式选择, 可以先用IoUringAvailable()检查
+        IOBackend backend{ IOBackend::Epoll };
+        std::size_t threads{ 0 };       //线程数, 0表示和CPU核数一样
+        //下面只对IoUring有效
+        std::size_t capacity{ 4096 };   //提交队列的长度
+        std::size_t max_submit{ 256 };  //每轮事件循环最多批量提交的请求数
+        std::size_t max_get{ 256 };     //每轮事件循环最多收割的完成数
+    };
+    /**
+     * 建立专用的IO线程池, 每个线程的EventBase使用options.backend
+     * 不支持io_uring(编译时没有liburing或者内核不支持)时抛std::runtime_error, 调用方可以回退到Epoll
+     */
+    REDIS_EXPORT std::shared_ptr<folly::IOExecutor> MakeIOPool(const IOPoolOptions& options);
+    //io_uring是否可用
+    REDIS_EXPORT bool IoUringAvailable();
+    /**
+     * 之后Connect的连接从pool取EventBase, nullptr恢复使用folly的全局IO线程池
+     * 已经连上的连接不受影响; 连接只持有EventBase的KeepAlive, 不持有线程池,
+     * 调用方要持有线程池直到使用它的连接都关闭并释放
+     */
+    REDIS_EXPORT void SetIOPool(std::shared_ptr<folly::IOExecutor> pool);
+    //当前连接使用的IO线程池, 没有设置时是folly的全局IO线程池
+    REDIS_EXPORT std::shared_ptr<folly::IOExecutor> GetIOPool();
+}
@@ -0,0 +1,102 @@
+#include "redis/line_scanner.h"
+
+#include <stdexcept>
+
+#include <folly/Conv.h>
+#include <folly/Portability.h>
+#include <folly/Range.h>
+#include <folly/io/Cursor.h>
+#include <folly/lang/Bits.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif FOLLY_SSE >= 2
+#include <emmintrin.h>
+#endif
+
+namespace redis
+{
+    const char* FindCR( const char* begin, const char* end )
+    {
+        auto p = begin;
+#if defined(__AVX2__)
+        const auto cr32 = _mm256_set1_epi8( '\r' );
+        for ( ; end - p >= 32; p += 32 ) {
+            const auto chunk = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( p ) );
+            const auto mask = static_cast<uint32_t>( _mm256_movemask_epi8( _mm256_cmpeq_epi8( chunk, cr32 ) ) );
+            if ( mask != 0 )return p + folly::findFirstSet( mask ) - 1;
+        }
+#endif
+#if defined(__AVX2__) || FOLLY_SSE >= 2
+        const auto cr16 = _mm_set1_epi8( '\r' );
+        for ( ; end - p >= 16; p += 16 ) {
+            const auto chunk = _mm_loadu_si128( reinterpret_cast<const __m128i*>( p ) );
+            const auto mask = static_cast<uint32_t>( _mm_movemask_epi8( _mm_cmpeq_epi8( chunk, cr16 ) ) );
+            if ( mask != 0 )return p + folly::findFirstSet( mask ) - 1;
+        }
+#endif
+        for ( ; p < end; ++p ) {
+            if ( *p == '\r' )return p;
+        }
+        return end;
+    }
+
+    int64_t LineScanner::Find( const folly::IOBufQueue& buf )
+    {
+        const auto* head = buf.front();
+        if ( !head )return -1;
+        std::size_t offset = 0;
+        const auto* cur = head;
+        do
+        {
+            const auto len = cur->length();
+            //整块都扫描过了
+            if ( offset + len <= scanned_ ) {
+                offset += len;
+                cur = cur->next();
+                continue;
+            }
+            const auto* data = reinterpret_cast<const char*>( cur->data() );
+            const auto* end = data + len;
+            for ( auto p = FindCR( data + ( scanned_ - offset ), end ); p != end; p = FindCR( p + 1, end ) )
+            {
+                const auto pos = offset + static_cast<std::size_t>( p - data );
+                if ( p + 1 < end ) {
+                    if ( p[1] == '\n' )return static_cast<int64_t>( pos );
+                    continue;
+                }
+                //\r是这个buffer的最后一个字节, 看下一个非空buffer的第一个字节
+                auto next = cur->next();
+                while ( next != head && next->length() == 0 )next = next->next();
+                if ( next == head ) {
+                    //\r后面还没有数据, 下次从这个\r开始
+                    scanned_ = pos;
+                    return -1;
+                }
+                if ( *next->data() == '\n' )return static_cast<int64_t>( pos );
+                //\r后面不是\n, 接着扫描下一个buffer
+            }
+            offset += len;
+            scanned_ = offset;
+            cur = cur->next();
+        } while ( cur != head );
+        return -1;
+    }
+
+    int64_t ParseInteger( const folly::IOBufQueue& buf, std::size_t offset, std::size_t len )
+    {
+        //int64最长20个字符
+        constexpr std::size_t MAX_INTEGER_LEN = 20;
+        if ( len == 0 || len > MAX_INTEGER_LEN )throw std::runtime_error( "invalid integer line" );
+        const auto* head = buf.front();
+        if ( head && offset + len <= head->length() ) {
+            return folly::to<int64_t>( folly::StringPiece( reinterpret_cast<const char*>( head->data() ) + offset, len ) );
+        }
+        //跨buffer了, 拷贝到栈上
+        char tmp[MAX_INTEGER_LEN];
+        folly::io::Cursor cur( head );
+        cur.skip( offset );
+        cur.pull( tmp, len );
+        return folly::to<int64_t>( folly::StringPiece( tmp, len ) );
+    }
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#include <folly/io/IOBufQueue.h>
+
+#include "redis/redis_export.h"
+namespace redis
+{
+    /**
+     * 在读缓冲中查找RESP行结束符\r\n
+     * 记录已经扫描过的字节数, 数据分多次到达时只扫描新到的部分
+     * 队列头部的数据被消费后必须调用Reset
+     */
+    class REDIS_EXPORT LineScanner
+    {
+    public:
+        //返回\r相对队列头的偏移, 没有完整的行返回-1
+        int64_t Find( const folly::IOBufQueue& buf );
+        void Reset() {
+            scanned_ = 0;
+        }
+        std::size_t Scanned() const {
+            return scanned_;
+        }
+    private:
+        std::size_t scanned_{ 0 };
+    };
+
+    //返回[begin,end)中第一个\r的位置, 没有返回end
+    REDIS_EXPORT const char* FindCR( const char* begin, const char* end );
+
+    //直接在队列中解析[offset, offset+len)的整数, 不拷贝出来
+    REDIS_EXPORT int64_t ParseInteger( const folly::IOBufQueue& buf, std::size_t offset, std::size_t len );
+}
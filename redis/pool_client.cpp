@@ -0,0 +1,147 @@
+#include "redis/pool_client.h"
+
+#include <functional>
+#include <stdexcept>
+#include <string_view>
+
+#include <folly/futures/Future.h>
+
+namespace redis
+{
+    namespace
+    {
+        constexpr const char* kMixedKeysError = "pipeline commands in key affine pool must map to the same connection";
+    }
+    folly::Future<folly::Unit>
+    PoolClient::Connect(const std::string &host, int port, const std::string &pass, int dbindex, int32_t timeout_ms) {
+        if (!conns_.empty()) {
+            return folly::makeFuture<folly::Unit>(std::logic_error("pool client is already connected"));
+        }
+        std::vector<folly::SemiFuture<folly::Unit>> futures;
+        futures.reserve(size_);
+        for (std::size_t i = 0; i < size_; i++) {
+            //Conn::Connect从IO线程池轮流取EventBase, 连接分散在各个IO线程上
+            auto conn = std::make_shared<Conn>(Conn::SINGLE);
+            conn->SetProtocol(protocol_);
+            conn->SetReplyArena(reply_arena_);
+            conn->SetAutoPipeline(auto_pipeline_);
+            conn->SetLimits(limits_);
+            futures.emplace_back(conn->Connect(host, port, pass, dbindex, timeout_ms, conn_options_));
+            conns_.emplace_back(std::move(conn));
+        }
+        return folly::collect(std::move(futures)).via(exec_).unit();
+    }
+    void PoolClient::Close() {
+        for (auto& conn : conns_) {
+            conn->Close();
+        }
+    }
+    bool PoolClient::IsConnected()const {
+        for (auto& conn : conns_) {
+            if (conn->IsConnected())return true;
+        }
+        return false;
+    }
+    std::size_t PoolClient::KeyHash(std::string_view key)
+    {
+        const auto s = key.find('{');
+        if (s != std::string_view::npos) {
+            const auto e = key.find('}', s + 1);
+            if (e != std::string_view::npos && e != s + 1) {
+                key = key.substr(s + 1, e - s - 1);
+            }
+        }
+        return std::hash<std::string_view>()(key);
+    }
+    int64_t PoolClient::AffineIndex(const Command& cmd, std::size_t conns)
+    {
+        int64_t index = kNoKey;
+        for (auto& c : cmd.Commands()) {
+            if (c.key.empty())continue;
+            const auto i = static_cast<int64_t>(KeyHash(c.key) % conns);
+            if (index < 0)index = i;
+            if (index != i)return kMixedKeys;
+        }
+        return index;
+    }
+    Conn* PoolClient::pick(const Command& cmd)
+    {
+        if (balance_ == Balance::KeyAffine && conns_.size() > 1) {
+            const auto index = AffineIndex(cmd, conns_.size());
+            if (index == kMixedKeys)return nullptr;
+            if (index >= 0)return conns_[static_cast<std::size_t>(index)].get();
+        }
+        return leastOutstanding().get();
+    }
+    Conn* PoolClient::pick(std::string_view key)
+    {
+        if (balance_ == Balance::KeyAffine && conns_.size() > 1 && !key.empty()) {
+            return conns_[KeyHash(key) % conns_.size()].get();
+        }
+        return leastOutstanding().get();
+    }
+    const std::shared_ptr<Conn>& PoolClient::leastOutstanding()
+    {
+        const auto start = next_.fetch_add(1, std::memory_order_relaxed);
+        const auto n = conns_.size();
+        if (balance_ == Balance::RoundRobin || n == 1) {
+            return conns_[start % n];
+        }
+        //从轮流的起点开始找, 未完成数相同时不会总是落到第一个连接
+        std::size_t best = start % n;
+        std::size_t least = conns_[best]->Inflight();
+        for (std::size_t i = 1; i < n && least > 0; i++) {
+            const auto idx = (start + i) % n;
+            const auto inflight = conns_[idx]->Inflight();
+            if (inflight < least) {
+                best = idx;
+                least = inflight;
+            }
+        }
+        return conns_[best];
+    }
+    folly::Future<Reply> PoolClient::Query(Command cmd)
+    {
+        if (conns_.empty()) {
+            return folly::makeFuture<Reply>(std::runtime_error("pool client is not connected"));
+        }
+        auto* conn = pick(cmd);
+        if (!conn) {
+            return folly::makeFuture<Reply>(std::invalid_argument(kMixedKeysError));
+        }
+        return complete(conn->Query(std::move(cmd)));
+    }
+    folly::Future<Reply> PoolClient::QueryStream(Command cmd, ChunkCallback cb)
+    {
+        if (conns_.empty()) {
+            return folly::makeFuture<Reply>(std::runtime_error("pool client is not connected"));
+        }
+        auto* conn = pick(cmd);
+        if (!conn) {
+            return folly::makeFuture<Reply>(std::invalid_argument(kMixedKeysError));
+        }
+        return complete(conn->QueryStream(std::move(cmd), std::move(cb)));
+    }
+    void PoolClient::Run(Command cmd)
+    {
+        if (conns_.empty())return;
+        auto* conn = pick(cmd);
+        if (!conn) {
+            XLOGF(ERR,"redis pool client drop command: {}", kMixedKeysError);
+            return;
+        }
+        conn->Run(std::move(cmd));
+    }
+    folly::Future<Reply> PoolClient::QueryPrepared(std::unique_ptr<folly::IOBuf> cmd, std::string_view key)
+    {
+        if (conns_.empty()) {
+            return folly::makeFuture<Reply>(std::runtime_error("pool client is not connected"));
+        }
+        return complete(pick(key)->QueryPrepared(std::move(cmd)));
+    }
+    void PoolClient::RunPrepared(std::unique_ptr<folly::IOBuf> cmd, std::string_view key)
+    {
+        if (conns_.empty())return;
+        pick(key)->RunPrepared(std::move(cmd));
+    }
+}
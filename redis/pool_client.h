@@ -0,0 +1,82 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <folly/logging/xlog.h>
+
+#include "redis/client_interface.h"
+#include "redis/conn.h"
+namespace redis
+{
+    /**
+     * 多个连接的客户端, 连接分散在IO线程池(默认folly的全局IO线程池, 见SetIOPool)的各个IO线程上
+     * 每个请求(包括Pipeline())整体发到一个连接; MULTI/EXEC/WATCH要放在同一个Pipeline()里
+     * 多个连接之间不保证执行顺序, 同一个key要求有序时用Balance::KeyAffine
+     * KeyAffine模式下Pipeline()中的key要落到同一个连接(用同一个{hash tag}), 否则Query的future是std::invalid_argument异常, Run打日志后丢弃
+     */
+    class REDIS_EXPORT PoolClient:public ClientInterface{
+    public:
+        //选连接的策略
+        enum class Balance
+        {
+            LeastOutstanding,   //未完成的命令最少的连接
+            RoundRobin,         //轮流
+            KeyAffine,          //按key哈希固定到一个连接, 同一个key保持提交顺序; 没有key的命令按LeastOutstanding
+        };
+        explicit PoolClient(folly::Executor* ex, std::size_t size = 4, Balance balance = Balance::LeastOutstanding)
+        :ClientInterface(ex), size_(size == 0 ? 1 : size), balance_(balance){}
+        ~PoolClient()override{
+            XLOG(DBG,"redis pool client release");
+        }
+        using ClientInterface::Connect;
+        //所有连接都连上才算成功
+        folly::Future<folly::Unit> Connect( const std::string& host, int port, const std::string& pass = "", int dbindex = 0, int32_t timeout_ms = 2000 )override;
+        void Close() override;
+        //至少有一个连接可用
+        bool IsConnected()const;
+    public:
+        //Connect之前调用
+        void SetSize(std::size_t size) { size_ = size == 0 ? 1 : size; }
+        std::size_t Size()const { return size_; }
+        void SetBalance(Balance balance) { balance_ = balance; }
+        Balance GetBalance()const { return balance_; }
+        //Connect之前调用, 见RedisClient
+        void SetProtocol(int protover) { protocol_ = protover; }
+        void SetReplyArena(bool enable) { reply_arena_ = enable; }
+        void SetAutoPipeline(bool enable) { auto_pipeline_ = enable; }
+        //Connect之前调用, 每个连接的背压设置, 见Conn::SetLimits
+        void SetLimits(const ConnLimits& limits) { limits_ = limits; }
+        const std::vector<std::shared_ptr<Conn>>& Connections()const { return conns_; }
+        //和集群一样只哈希{hash tag}里的部分, 同一个tag的key落到同一个连接
+        static std::size_t KeyHash(std::string_view key);
+        //AffineIndex的特殊返回值
+        static constexpr int64_t kNoKey = -1;
+        static constexpr int64_t kMixedKeys = -2;
+        //KeyAffine模式下cmd落到的连接下标, 没有key返回kNoKey, key落到不同的连接返回kMixedKeys
+        static int64_t AffineIndex(const Command& cmd, std::size_t conns);
+    protected:
+        folly::Future<Reply> Query(Command cmd)override;
+        folly::Future<Reply> QueryStream(Command cmd, ChunkCallback cb)override;
+        void Run(Command cmd)override;
+        folly::Future<Reply> QueryPrepared(std::unique_ptr<folly::IOBuf> cmd, std::string_view key)override;
+        void RunPrepared(std::unique_ptr<folly::IOBuf> cmd, std::string_view key)override;
+    private:
+        //key落到不同的连接时返回nullptr
+        Conn* pick(const Command& cmd);
+        Conn* pick(std::string_view key);
+        const std::shared_ptr<Conn>& leastOutstanding();
+    private:
+        std::vector<std::shared_ptr<Conn>> conns_;
+        std::atomic<std::size_t> next_{0};
+        std::size_t size_;
+        Balance balance_;
+        int protocol_{2};
+        bool reply_arena_{false};
+        bool auto_pipeline_{false};
+        ConnLimits limits_;
+    };
+}
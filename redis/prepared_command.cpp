@@ -0,0 +1,111 @@
+#include "redis/prepared_command.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include <folly/lang/Exception.h>
+
+#include "redis/client_interface.h"
+
+namespace redis{
+
+    namespace {
+        //解析"<type><num>\r\n", pos移到下一行开头
+        std::size_t parseLength(const std::string& data, std::size_t& pos, char type){
+            if(pos >= data.size() || data[pos] != type){
+                folly::throw_exception(std::invalid_argument("malformed command"));
+            }
+            const auto crlf = data.find("\r\n", pos);
+            if(crlf == std::string::npos){
+                folly::throw_exception(std::invalid_argument("malformed command"));
+            }
+            const auto len = folly::to<std::size_t>(folly::StringPiece(data.data() + pos + 1, crlf - pos - 1));
+            pos = crlf + 2;
+            return len;
+        }
+    }
+
+    PreparedCommand::PreparedCommand(Command& cmd, std::vector<std::size_t> slots)
+    :client_(cmd.client_)
+    {
+        cmd.buildCommand();
+        if(cmd.cmds_.size() != 1){
+            folly::throw_exception(std::invalid_argument("PreparedCommand needs exactly one command"));
+        }
+        auto& val = cmd.cmds_.front();
+        template_ = val.ToString();
+        key_ = val.key;
+
+        std::sort(slots.begin(), slots.end());
+        slots.erase(std::unique(slots.begin(), slots.end()), slots.end());
+
+        std::size_t pos = 0;
+        const auto argc = parseLength(template_, pos, '*');
+        if(!slots.empty() && (slots.front() == 0 || slots.back() >= argc)){
+            folly::throw_exception(std::invalid_argument("slot out of range"));
+        }
+        auto next = slots.begin();
+        for(std::size_t i = 0; i < argc; i++){
+            const auto begin = pos;
+            const auto len = parseLength(template_, pos, '$');
+            pos += len + 2;
+            if(pos > template_.size()){
+                folly::throw_exception(std::invalid_argument("malformed command"));
+            }
+            if(next == slots.end() || *next != i)continue;
+            if(val.key_arg == static_cast<int32_t>(i)){
+                key_slot_ = static_cast<int>(slots_.size());
+            }
+            slots_.push_back({begin, pos});
+            ++next;
+        }
+        fixed_size_ = template_.size();
+        for(auto& slot : slots_){
+            fixed_size_ -= slot.end - slot.begin;
+        }
+    }
+
+    std::unique_ptr<folly::IOBuf> PreparedCommand::bind(const SlotValue* values, std::size_t count)const
+    {
+        if(count != slots_.size()){
+            folly::throw_exception(std::invalid_argument("PreparedCommand argument count mismatch"));
+        }
+        std::size_t total = fixed_size_;
+        for(std::size_t i = 0; i < count; i++){
+            const auto len = values[i].View().size();
+            total += 1 + folly::digits10(len) + 2 + len + 2;
+        }
+        auto buf = folly::IOBuf::create(total);
+        auto* out = reinterpret_cast<char*>(buf->writableData());
+        std::size_t pos = 0;
+        for(std::size_t i = 0; i < count; i++){
+            std::memcpy(out, template_.data() + pos, slots_[i].begin - pos);
+            out += slots_[i].begin - pos;
+            const auto value = values[i].View();
+            *out++ = '$';
+            out += folly::uint64ToBufferUnsafe(value.size(), out);
+            *out++ = '\r';
+            *out++ = '\n';
+            if(!value.empty())std::memcpy(out, value.data(), value.size());
+            out += value.size();
+            *out++ = '\r';
+            *out++ = '\n';
+            pos = slots_[i].end;
+        }
+        std::memcpy(out, template_.data() + pos, template_.size() - pos);
+        buf->append(total);
+        return buf;
+    }
+
+    folly::Future<Reply> PreparedCommand::query(std::unique_ptr<folly::IOBuf> cmd, std::string_view key)const
+    {
+        if(!client_)return folly::makeFuture<Reply>(std::runtime_error("need a valid redis client"));
+        return client_->QueryPrepared(std::move(cmd), key);
+    }
+
+    void PreparedCommand::run(std::unique_ptr<folly::IOBuf> cmd, std::string_view key)const
+    {
+        if(client_)client_->RunPrepared(std::move(cmd), key);
+    }
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include <folly/Conv.h>
+#include <folly/futures/Future.h>
+#include <folly/io/IOBuf.h>
+
+#include "redis/command.h"
+namespace redis{
+    class ClientInterface;
+
+    /**
+     * 预先序列化好的命令, 部分参数是槽位, 每次调用只填槽位
+     * 例如: auto incr = PreparedCommand(client->Cmd().HIncrby("stats:{0}", "field", 1), {1, 3});
+     *       incr.Query("stats:{7}", 5);
+     * 绑定时按槽位的长度分配一个IOBuf, 固定部分整段拷贝, 不分配vector和string
+     * Query/Run把绑定好的IOBuf直接交给客户端, 不构造Command
+     */
+    class PreparedCommand{
+    public:
+        /**
+         * cmd中只能有一条命令, 只读取序列化结果; slots是作为槽位的参数下标, 命令名是0
+         * 命令的key(用Key()加的参数)是槽位时, 绑定的值作为路由的key
+         */
+        PreparedCommand(Command& cmd, std::vector<std::size_t> slots);
+
+        std::size_t Slots()const{
+            return slots_.size();
+        }
+        //按槽位顺序填入参数, 生成完整的命令
+        template<class... Args>
+        std::unique_ptr<folly::IOBuf> Bind(const Args&... args)const{
+            const std::array<SlotValue, sizeof...(Args)> values{ SlotValue(args)... };
+            return bind(values.data(), values.size());
+        }
+        //绑定后追加到pipeline中
+        template<class... Args>
+        Command& BindTo(Command& cmd, const Args&... args)const{
+            const std::array<SlotValue, sizeof...(Args)> values{ SlotValue(args)... };
+            cmd.appendSerialized(bind(values.data(), values.size()), std::string(key(values.data())));
+            return cmd;
+        }
+        template<class... Args>
+        folly::Future<Reply> Query(const Args&... args)const{
+            const std::array<SlotValue, sizeof...(Args)> values{ SlotValue(args)... };
+            return query(bind(values.data(), values.size()), key(values.data()));
+        }
+        template<class... Args>
+        void Run(const Args&... args)const{
+            const std::array<SlotValue, sizeof...(Args)> values{ SlotValue(args)... };
+            run(bind(values.data(), values.size()), key(values.data()));
+        }
+    private:
+        //槽位的值, 整数直接格式化到buf_
+        class SlotValue{
+        public:
+            SlotValue(std::string_view str):data_(str.data()), size_(str.size()){}
+            SlotValue(const std::string& str):data_(str.data()), size_(str.size()){}
+            SlotValue(const char* str):SlotValue(std::string_view(str)){}
+            template<class T, std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool>, int> = 0>
+            SlotValue(T val){
+                auto* out = buf_;
+                uint64_t abs = static_cast<uint64_t>(val);
+                if constexpr (std::is_signed_v<T>) {
+                    if(val < 0){
+                        *out++ = '-';
+                        abs = 0 - abs;
+                    }
+                }
+                size_ = (out - buf_) + folly::uint64ToBufferUnsafe(abs, out);
+            }
+            std::string_view View()const{
+                return data_ ? std::string_view(data_, size_) : std::string_view(buf_, size_);
+            }
+        private:
+            const char* data_{nullptr};
+            std::size_t size_{0};
+            char buf_[24];
+        };
+        //参数在模板中的位置[begin, end), 包括"$len\r\n"和结尾的"\r\n"
+        struct Slot{
+            std::size_t begin;
+            std::size_t end;
+        };
+        std::unique_ptr<folly::IOBuf> bind(const SlotValue* values, std::size_t count)const;
+        //只在调用期间有效
+        std::string_view key(const SlotValue* values)const{
+            if(key_slot_ < 0)return key_;
+            return values[key_slot_].View();
+        }
+        folly::Future<Reply> query(std::unique_ptr<folly::IOBuf> cmd, std::string_view key)const;
+        void run(std::unique_ptr<folly::IOBuf> cmd, std::string_view key)const;
+    private:
+        //序列化好的完整命令
+        std::string template_;
+        std::vector<Slot> slots_;
+        //去掉槽位后的长度
+        std::size_t fixed_size_{0};
+        //key所在的槽位, -1表示key固定
+        int key_slot_{-1};
+        std::string key_;
+        std::shared_ptr<ClientInterface> client_;
+    };
+}
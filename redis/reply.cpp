@@ -1,15 +1,117 @@
 #include "redis/reply.h"
+#include <algorithm>
+#include <cstring>
+#include <new>
 #include <sstream>
+#include <type_traits>
 namespace redis
 {
-    Reply::Reply( Reply&& other ) noexcept
+    folly::StringPiece ReplyArena::Copy( folly::StringPiece str )
+    {
+        if ( str.empty() )return {};
+        auto* data = static_cast<char*>( resource_.allocate( str.size(), 1 ) );
+        std::memcpy( data, str.data(), str.size() );
+        return { data, str.size() };
+    }
+
+    ReplyArena* ReplyArena::Create( std::size_t size )
+    {
+        //第一块缓冲紧跟在arena后面, 一次分配
+        constexpr std::size_t align = alignof( std::max_align_t );
+        constexpr std::size_t header = ( sizeof( ReplyArena ) + align - 1 ) / align * align;
+        size = std::clamp( size, kMinInitialSize, kMaxInitialSize );
+        auto* mem = static_cast<std::byte*>( ::operator new( header + size ) );
+        return new ( mem ) ReplyArena( mem + header, size );
+    }
+
+    void Reply::ArenaDeleter::operator()( ReplyArena* arena ) const
+    {
+        arena->~ReplyArena();
+        ::operator delete( arena );
+    }
+
+    Reply::Slice::Slice( const Slice& other )
+        : buf( other.buf ? other.buf->clone() : nullptr )
+        , str( other.str ? std::make_unique<std::string>( *other.str ) : nullptr )
+    {
+    }
+
+    Reply::Slice& Reply::Slice::operator=( const Slice& other )
     {
         if ( this != &other ) {
-            type_ = other.type_;
-            arr_val_ = std::move( other.arr_val_ );
-            str_val_ = std::move( other.str_val_ );
-            int_val_ = other.int_val_;
-            other.type_ = Type::Null;
+            *this = Slice( other );
+        }
+        return *this;
+    }
+
+    Reply::Reply( Root arena, ArenaArray rows, Type type )
+        : type_( type )
+    {
+        arena->rows_ = std::move( rows );
+        val_ = std::move( arena );
+    }
+
+    Reply::~Reply() = default;
+
+    Reply::Reply( const Reply& other )
+        : type_( other.type_ )
+        , val_( std::visit( []( const auto& val ) -> Value {
+            using T = std::decay_t<decltype( val )>;
+            //arena里的数据拷贝到堆上, 拷贝出来的reply和arena无关
+            if constexpr ( std::is_same_v<T, View> ) {
+                return std::string( val.str.data(), val.str.size() );
+            } else if constexpr ( std::is_same_v<T, Root> ) {
+                return Array( val->rows_.begin(), val->rows_.end() );
+            } else if constexpr ( std::is_same_v<T, ArenaArray> ) {
+                return Array( val.begin(), val.end() );
+            } else {
+                return val;
+            }
+        }, other.val_ ) )
+    {
+    }
+
+    Reply& Reply::operator=( const Reply& other )
+    {
+        if ( this != &other ) {
+            *this = Reply( other );
+        }
+        return *this;
+    }
+
+    Reply::Reply( Reply&& other ) noexcept
+        : type_( other.type_ )
+        , val_( std::move( other.val_ ) )
+    {
+        other.type_ = Type::Null;
+        other.val_ = std::monostate();
+    }
+
+    void Reply::setSlice( std::unique_ptr<folly::IOBuf> value )
+    {
+        if ( !value || value->empty() ) {
+            val_ = std::string();
+            return;
+        }
+        //切片在这里合并一次, AsStringPiece()就不用修改reply
+        if ( value->isChained() ) value->coalesce();
+        Slice slice;
+        slice.buf = std::move( value );
+        val_ = std::move( slice );
+    }
+
+    void Reply::push( Reply&& reply )
+    {
+        type_ = Type::Array;
+        if ( auto* root = std::get_if<Root>( &val_ ) ) {
+            ( *root )->rows_.push_back( std::move( reply ) );
+        } else if ( auto* rows = std::get_if<ArenaArray>( &val_ ) ) {
+            rows->push_back( std::move( reply ) );
+        } else {
+            if ( !std::holds_alternative<Array>( val_ ) ) {
+                val_ = Array();
+            }
+            std::get<Array>( val_ ).push_back( std::move( reply ) );
         }
     }
 
@@ -23,46 +125,112 @@ namespace redis
     const std::string& Reply::Error() const
     {
         if ( !IsError() )throw std::runtime_error( "Reply is not an error" );
-        return str_val_;
+        return AsString();
     }
 
-    const std::vector<Reply>& Reply::AsArray() const&
+    const Reply::Array& Reply::AsArray() const&
     {
-        if ( !IsArray() )throw std::runtime_error( "Reply is not an array" );
-        return arr_val_;
+        if ( !IsAggregate() )throw std::runtime_error( "Reply is not an array" );
+        if ( auto* rows = std::get_if<Array>( &val_ ) ) return *rows;
+        throw std::runtime_error( "Reply is an arena array, use Rows()" );
     }
 
-    std::vector<Reply> Reply::AsArray() &&
+    Reply::RowRange Reply::Rows() const
     {
-        if (!IsArray())throw std::runtime_error("Reply is not an array");
-        return std::move(arr_val_);
+        if ( !IsAggregate() )throw std::runtime_error( "Reply is not an array" );
+        if ( auto* root = std::get_if<Root>( &val_ ) ) return RowRange( ( *root )->rows_.data(), ( *root )->rows_.size() );
+        if ( auto* rows = std::get_if<ArenaArray>( &val_ ) ) return RowRange( rows->data(), rows->size() );
+        const auto& rows = std::get<Array>( val_ );
+        return RowRange( rows.data(), rows.size() );
+    }
+
+    Reply::Array Reply::AsArray() &&
+    {
+        if (!IsAggregate())throw std::runtime_error("Reply is not an array");
+        //arena随reply一起释放, 元素不能带出去
+        if ( auto* root = std::get_if<Root>( &val_ ) ) return Array( ( *root )->rows_.begin(), ( *root )->rows_.end() );
+        if ( auto* rows = std::get_if<ArenaArray>( &val_ ) ) return Array( rows->begin(), rows->end() );
+        return std::move(std::get<Array>( val_ ));
     }
 
     const std::string& Reply::AsString() const&
     {
         if ( !IsString() )throw std::runtime_error( "Reply is not a string" );
-        return str_val_;
+        if ( auto* slice = std::get_if<Slice>( &val_ ) ) {
+            if ( !slice->str ) {
+                slice->str = std::make_unique<std::string>();
+                slice->str->reserve( slice->buf->computeChainDataLength() );
+                for ( auto range : *slice->buf ) {
+                    slice->str->append( reinterpret_cast<const char*>( range.data() ), range.size() );
+                }
+            }
+            return *slice->str;
+        }
+        if ( auto* view = std::get_if<View>( &val_ ) ) {
+            if ( !view->cache ) view->cache = std::make_unique<std::string>( view->str.data(), view->str.size() );
+            return *view->cache;
+        }
+        return std::get<std::string>( val_ );
     }
 
     std::string Reply::AsString() &&
     {
         if (!IsString())throw std::runtime_error("Reply is not a string");
-        return std::move(str_val_);
+        if ( std::holds_alternative<Slice>( val_ ) || std::holds_alternative<View>( val_ ) ) {
+            std::string str = static_cast<const Reply&>( *this ).AsString();
+            val_ = std::string();
+            return str;
+        }
+        return std::move(std::get<std::string>( val_ ));
+    }
+
+    folly::StringPiece Reply::AsStringPiece() const
+    {
+        if ( !IsString() )throw std::runtime_error( "Reply is not a string" );
+        if ( auto* view = std::get_if<View>( &val_ ) ) return view->str;
+        auto* slice = std::get_if<Slice>( &val_ );
+        if ( !slice ) return std::get<std::string>( val_ );
+        return { reinterpret_cast<const char*>( slice->buf->data() ), slice->buf->length() };
+    }
+
+    std::unique_ptr<folly::IOBuf> Reply::AsIOBuf() const
+    {
+        if ( !IsString() )throw std::runtime_error( "Reply is not a string" );
+        if ( auto* slice = std::get_if<Slice>( &val_ ) ) return slice->buf->clone();
+        if ( auto* view = std::get_if<View>( &val_ ) ) return folly::IOBuf::copyBuffer( view->str.data(), view->str.size() );
+        return folly::IOBuf::copyBuffer( std::get<std::string>( val_ ) );
     }
     int64_t Reply::AsInteger() const
     {
         if ( !IsInteger() )throw std::runtime_error( "Reply is not an integer" );
-        return int_val_;
+        return std::get<int64_t>( val_ );
+    }
+
+    double Reply::AsDouble() const
+    {
+        if ( IsInteger() )return static_cast<double>( std::get<int64_t>( val_ ) );
+        if ( !IsDouble() )throw std::runtime_error( "Reply is not a double" );
+        return std::get<double>( val_ );
+    }
+
+    bool Reply::AsBool() const
+    {
+        if ( !IsBoolean() )throw std::runtime_error( "Reply is not a boolean" );
+        return std::get<int64_t>( val_ ) != 0;
     }
 
     Reply& Reply::operator=( Reply&& other ) noexcept
     {
         if ( this != &other ) {
-            type_ = other.type_;
-            arr_val_ = std::move( other.arr_val_ );
-            str_val_ = std::move( other.str_val_ );
-            int_val_ = other.int_val_;
+            //other可能是自己的子元素, 先移出来再替换
+            Value val( std::move( other.val_ ) );
+            const auto type = other.type_;
             other.type_ = Type::Null;
+            other.val_ = std::monostate();
+            type_ = type;
+            //先清空再构造: 两边都是数组时直接移动赋值会按元素搬到原来的allocator里
+            val_ = std::monostate();
+            val_ = std::move( val );
         }
         return *this;
     }
@@ -80,8 +248,12 @@ std::ostream& operator<<( std::ostream& os, const redis::Reply& reply )
     case redis::Reply::Type::SimpleString:
     case redis::Reply::Type::BulkString:
     case redis::Reply::Type::Error:
+    case redis::Reply::Type::AskError:
+    case redis::Reply::Type::MovedError:
+    case redis::Reply::Type::BigNumber:
+    case redis::Reply::Type::Verbatim:
     {
-        os << reply.AsString();
+        os << reply.AsStringPiece();
         break;
     }
     case redis::Reply::Type::Integer:
@@ -89,10 +261,31 @@ std::ostream& operator<<( std::ostream& os, const redis::Reply& reply )
         os << reply.AsInteger();
         break;
     }
+    case redis::Reply::Type::Double:
+    {
+        os << reply.AsDouble();
+        break;
+    }
+    case redis::Reply::Type::Boolean:
+    {
+        os << ( reply.AsBool() ? "true" : "false" );
+        break;
+    }
+    case redis::Reply::Type::Map:
+    {
+        const auto arr = reply.Rows();
+        os << "{";
+        for ( std::size_t i = 0; i + 1 < arr.size(); i += 2 )
+            os << arr[i] << ":" << arr[i + 1] << ",";
+        os << "}";
+        break;
+    }
     case redis::Reply::Type::Array:
+    case redis::Reply::Type::Set:
+    case redis::Reply::Type::Push:
     {
         os << "[";
-        for ( const auto& item : reply.AsArray() )
+        for ( const auto& item : reply.Rows() )
             os << item << ",";
         os << "]";
         break;
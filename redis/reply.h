@@ -1,18 +1,32 @@
 #pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
 #include <string>
 #include <utility>
+#include <variant>
 #include <vector>
 
+#include <folly/Range.h>
+#include <folly/io/IOBuf.h>
+
 #include "redis/redis_export.h"
 namespace redis
 {
+    class ReplyArena;
+    class ReplyBuilder;
     /**
      * redis reply
+     * 只保存当前类型用到的数据: 整数/浮点直接存在variant里, 短字符串用std::string的SSO,
+     * 读缓冲的切片和数组各占一个指针大小的头
+     * arena模式下(见ReplyBuilder::SetArena)整棵树的数组和短字符串都分配在根节点持有的ReplyArena中,
+     * 拷贝或者移出来的数组不再引用arena
      */
     class REDIS_EXPORT Reply
     {
     public:
-        enum class Type
+        enum class Type : uint8_t
         {
             Error = 0,
             BulkString = 1,
@@ -22,24 +36,43 @@ namespace redis
             Array = 5,
             AskError=6,
             MovedError=7,
+            //RESP3
+            Double=8,
+            Boolean=9,
+            BigNumber=10,
+            Verbatim=11,
+            Map=12,
+            Set=13,
+            Push=14,
         };
-        enum class StringType
+        enum class StringType : uint8_t
         {
             Error = 0,
             BulkString = 1,
             SimpleString = 2,
             AskError=6,
             MovedError=7,
+            BigNumber=10,
+            Verbatim=11,
         };
+        using Array = std::vector<Reply>;
+        //数组元素的只读视图, 堆上和arena中的数组都可以访问, 见Rows()
+        using RowRange = folly::Range<const Reply*>;
     public:
         Reply() : type_{ Type::Null } {};
-        Reply( std::string  value, StringType type ) : type_{ static_cast<Type>( type ) }, str_val_(std::move( value )) {};
-        explicit Reply( int64_t val ) : type_{ Type::Integer }, int_val_{val} {};
-        explicit Reply( std::vector<Reply>  rows ) : type_{ Type::Array }, arr_val_{std::move( rows )} {};
+        Reply( std::string  value, StringType type ) : type_{ static_cast<Type>( type ) }, val_{ std::move( value ) } {};
+        //payload直接引用传入的缓冲, 不拷贝; 跨多个缓冲时合并成一块
+        Reply( std::unique_ptr<folly::IOBuf> value, StringType type ) : type_{ static_cast<Type>( type ) } {
+            setSlice( std::move( value ) );
+        };
+        explicit Reply( int64_t val ) : type_{ Type::Integer }, val_{ val } {};
+        explicit Reply( Array rows ) : type_{ Type::Array }, val_{ std::move( rows ) } {};
+        //type只能是Array,Map,Set,Push; Map按k1,v1,k2,v2...平铺
+        Reply( Array rows, Type type ) : type_{ type }, val_{ std::move( rows ) } {};
     public:
-        ~Reply() = default;
-        Reply( const Reply& ) = default;
-        Reply& operator=( const Reply& ) = default;
+        ~Reply();
+        Reply( const Reply& other );
+        Reply& operator=( const Reply& other );
         Reply( Reply&& ) noexcept;
         Reply& operator=( Reply&& ) noexcept;
     public:
@@ -65,11 +98,31 @@ namespace redis
             return type_ == Type::BulkString;
         }
         bool IsString()const {
-            return IsBulkString() || IsSimpleString() || IsError() || IsMovedError() || IsAskError();
+            return IsBulkString() || IsSimpleString() || IsError() || IsMovedError() || IsAskError()
+                || type_ == Type::BigNumber || type_ == Type::Verbatim;
         }
         bool IsInteger()const {
             return type_ == Type::Integer;
         }
+        bool IsDouble()const {
+            return type_ == Type::Double;
+        }
+        bool IsBoolean()const {
+            return type_ == Type::Boolean;
+        }
+        bool IsMap()const {
+            return type_ == Type::Map;
+        }
+        bool IsSet()const {
+            return type_ == Type::Set;
+        }
+        bool IsPush()const {
+            return type_ == Type::Push;
+        }
+        //Array,Map,Set,Push都可以用AsArray访问
+        bool IsAggregate()const {
+            return IsArray() || IsMap() || IsSet() || IsPush();
+        }
         bool Ok()const {
             return !IsError();
         }
@@ -79,48 +132,140 @@ namespace redis
         std::string ToString();
     public:
         const std::string& Error()const;
-        const std::vector<Reply>& AsArray() const&;
-        std::vector<Reply> AsArray() &&;
+        //堆上的数组; arena中的数组(见ReplyBuilder::SetArena)抛异常, 用Rows()访问
+        const Array& AsArray() const&;
+        //arena中的数组会拷贝一份到堆上
+        Array AsArray() &&;
+        //数组元素, 堆上和arena中的数组都可以用
+        RowRange Rows() const;
+        //payload是IOBuf切片时第一次调用才拷贝成std::string, 多线程同时第一次调用不安全
         const std::string& AsString() const&;
         std::string AsString()&&;
+        //payload的视图, reply存活期间有效, 不修改reply, 可以多线程同时调用
+        folly::StringPiece AsStringPiece() const;
+        //和reply共享缓冲的IOBuf
+        std::unique_ptr<folly::IOBuf> AsIOBuf() const;
         int64_t AsInteger() const;
+        double AsDouble() const;
+        bool AsBool() const;
     public:
         void set() {
             type_ = Type::Null;
+            val_ = std::monostate();
         };
         void set( std::string value, StringType type ) {
             type_ = static_cast<Type>( type );
-            str_val_ = std::move(value);
+            val_ = std::move( value );
+        }
+        void set( std::unique_ptr<folly::IOBuf> value, StringType type ) {
+            type_ = static_cast<Type>( type );
+            setSlice( std::move( value ) );
         }
         void set( int64_t value )
         {
             type_ = Type::Integer;
-            int_val_ = value;
+            val_ = value;
+        }
+        void setDouble( double value )
+        {
+            type_ = Type::Double;
+            val_ = value;
+        }
+        void setBool( bool value )
+        {
+            type_ = Type::Boolean;
+            val_ = static_cast<int64_t>( value ? 1 : 0 );
         }
-        void set( const std::vector<Reply>& rows )
+        void set( const Array& rows )
         {
             type_ = Type::Array;
-            arr_val_ = rows;
+            val_ = rows;
         }
         Reply& operator<<( const Reply& reply ) {
-            type_ = Type::Array;
-            arr_val_.push_back( reply );
+            push( Reply( reply ) );
             return *this;
         }
         Reply& operator<<( Reply&& reply ) {
-            type_ = Type::Array;
-            arr_val_.push_back( std::move(reply) );
+            push( std::move( reply ) );
             return *this;
         }
     public:
         Type GetType() const {
             return type_;
         }
+    private:
+        //读缓冲中的切片, AsString()时才拷贝成std::string
+        struct Slice
+        {
+            std::unique_ptr<folly::IOBuf> buf;
+            //buf总是一块连续的缓冲; str在AsString()第一次调用时才生成
+            mutable std::unique_ptr<std::string> str;
+            Slice() = default;
+            Slice( Slice&& ) noexcept = default;
+            Slice& operator=( Slice&& ) noexcept = default;
+            Slice( const Slice& other );
+            Slice& operator=( const Slice& other );
+        };
+        //arena中的字符串, 只在arena模式的树里出现
+        struct View
+        {
+            folly::StringPiece str;
+            mutable std::unique_ptr<std::string> cache;
+        };
+        struct ArenaDeleter
+        {
+            void operator()( ReplyArena* arena ) const;
+        };
+        //arena模式的根节点, 持有arena和自己的数组
+        using Root = std::unique_ptr<ReplyArena, ArenaDeleter>;
+        //arena中的数组, 只在arena模式的树里出现
+        using ArenaArray = std::pmr::vector<Reply>;
+        using Value = std::variant<std::monostate, int64_t, double, std::string, Slice, Array, View, Root, ArenaArray>;
+        friend class ReplyBuilder;
+        friend class ReplyArena;
+        //arena模式: 非根节点的数组
+        Reply( ArenaArray rows, Type type ) : type_{ type }, val_{ std::move( rows ) } {};
+        //arena模式: 挂到根节点上
+        Reply( Root arena, ArenaArray rows, Type type );
+        //arena模式: view指向arena中的数据
+        void setView( folly::StringPiece view, StringType type ) {
+            type_ = static_cast<Type>( type );
+            val_ = View{ view, nullptr };
+        }
+        void setSlice( std::unique_ptr<folly::IOBuf> value );
+        //转成数组并追加元素
+        void push( Reply&& reply );
     private:
         Type type_;
-        std::vector<Reply> arr_val_;
-        std::string str_val_{};
-        int64_t int_val_{};
+        Value val_;
+    };
+
+    /**
+     * 一个reply树的单调内存池, 只分配不释放, 随根节点一次性释放
+     * 第一块缓冲和arena本身一起分配, 大小按顶层元素个数估计, 不够再向堆申请更大的块
+     * 非线程安全, 只在解析时使用
+     */
+    class REDIS_EXPORT ReplyArena
+    {
+    public:
+        //第一块缓冲的大小范围
+        static constexpr std::size_t kMinInitialSize = 256;
+        static constexpr std::size_t kMaxInitialSize = 16 * 1024;
+        //size是第一块缓冲的期望大小, 由Reply::ArenaDeleter释放
+        static ReplyArena* Create( std::size_t size );
+        ReplyArena( const ReplyArena& ) = delete;
+        ReplyArena& operator=( const ReplyArena& ) = delete;
+        std::pmr::memory_resource* Resource() {
+            return &resource_;
+        }
+        //拷贝到arena中
+        folly::StringPiece Copy( folly::StringPiece str );
+    private:
+        friend class Reply;
+        ReplyArena( void* buffer, std::size_t size ) : resource_{ buffer, size } {}
+        std::pmr::monotonic_buffer_resource resource_;
+        //根节点的数组, 先于resource_析构
+        Reply::ArenaArray rows_{ &resource_ };
     };
 }
 
@@ -0,0 +1,78 @@
+#pragma once
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include <folly/lang/Bits.h>
+namespace redis
+{
+    /**
+     * 容量是2的幂的环形队列, 槽位预先构造好, 出队时赋值为T()还给环, 之后重复使用
+     * 满了才翻倍扩容, 稳定后入队出队不分配内存; 只在一个线程使用
+     */
+    template <class T>
+    class SlotRing
+    {
+    public:
+        explicit SlotRing( std::size_t capacity )
+            : slots_( folly::nextPowTwo( capacity < 2 ? std::size_t( 2 ) : capacity ) ),
+            mask_( slots_.size() - 1 )
+        {
+        }
+        bool empty() const { return size_ == 0; }
+        std::size_t size() const { return size_; }
+        std::size_t capacity() const { return slots_.size(); }
+        //第i个元素, 0是队头
+        T& operator[]( std::size_t i ) { return slots_[( head_ + i ) & mask_]; }
+        const T& operator[]( std::size_t i ) const { return slots_[( head_ + i ) & mask_]; }
+        T& front() { return slots_[head_]; }
+        void push_back( T&& val )
+        {
+            if ( size_ == slots_.size() ) {
+                //val可能就是环里的元素, 扩容前先移出来
+                T tmp( std::move( val ) );
+                grow();
+                slots_[size_++] = std::move( tmp );
+                return;
+            }
+            slots_[( head_ + size_ ) & mask_] = std::move( val );
+            size_++;
+        }
+        void push_front( T&& val )
+        {
+            if ( size_ == slots_.size() ) {
+                T tmp( std::move( val ) );
+                grow();
+                head_ = mask_;
+                slots_[head_] = std::move( tmp );
+                size_++;
+                return;
+            }
+            head_ = ( head_ - 1 ) & mask_;
+            slots_[head_] = std::move( val );
+            size_++;
+        }
+        void pop_front()
+        {
+            slots_[head_] = T();
+            head_ = ( head_ + 1 ) & mask_;
+            size_--;
+        }
+    private:
+        void grow()
+        {
+            std::vector<T> slots( slots_.size() * 2 );
+            for ( std::size_t i = 0; i < size_; i++ ) {
+                slots[i] = std::move( ( *this )[i] );
+            }
+            slots_.swap( slots );
+            mask_ = slots_.size() - 1;
+            head_ = 0;
+        }
+    private:
+        std::vector<T> slots_;
+        std::size_t mask_;
+        std::size_t head_{ 0 };
+        std::size_t size_{ 0 };
+    };
+}
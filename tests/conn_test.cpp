@@ -0,0 +1,191 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <folly/Conv.h>
+#include <folly/futures/Future.h>
+#include <folly/synchronization/Baton.h>
+
+#include "redis/conn.h"
+#include "tests/fake_server.h"
+
+namespace
+{
+    std::shared_ptr<redis::Conn> connect(const redis::test::FakeServer& server, bool auto_pipeline = false,
+        const redis::ConnLimits& limits = redis::ConnLimits())
+    {
+        auto conn = std::make_shared<redis::Conn>(redis::Conn::SINGLE);
+        conn->SetAutoPipeline(auto_pipeline);
+        conn->SetLimits(limits);
+        conn->Connect("127.0.0.1", server.Port()).get();
+        return conn;
+    }
+    redis::Command get(const std::string& key)
+    {
+        return std::move(redis::Command::Create(false).Get(key));
+    }
+}
+
+TEST(ConnTest,AutoPipelineOrder){
+    redis::test::FakeServer server;
+    auto conn = connect(server, true);
+
+    //同一轮事件循环中提交的命令合并成一次写出, 回包按提交顺序对应
+    constexpr std::size_t kCount = 200;
+    std::vector<folly::SemiFuture<redis::Reply>> replies;
+    const auto writes = conn->Stats().writes;
+    conn->GetEventBase()->runInEventBaseThreadAndWait([&]{
+        for (std::size_t i = 0; i < kCount; i++) {
+            replies.push_back(conn->Query(get(folly::to<std::string>("key",i))));
+        }
+    });
+    for (std::size_t i = 0; i < kCount; i++) {
+        EXPECT_EQ(std::move(replies[i]).get().AsString(),folly::to<std::string>("key",i));
+    }
+    EXPECT_EQ(conn->Stats().writes - writes,1);
+    const auto received = server.Received();
+    ASSERT_EQ(received.size(),kCount);
+    for (std::size_t i = 0; i < kCount; i++) {
+        EXPECT_EQ(received[i][1],folly::to<std::string>("key",i));
+    }
+}
+
+TEST(ConnTest,SubmitOrderAcrossThreads){
+    redis::test::FakeServer server;
+    auto conn = connect(server);
+
+    //多个线程同时提交, 经过submissions_之后每个线程自己的命令保持提交顺序
+    constexpr std::size_t kThreads = 4;
+    constexpr std::size_t kPerThread = 100;
+    std::vector<std::vector<folly::SemiFuture<redis::Reply>>> replies(kThreads);
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < kThreads; t++) {
+        threads.emplace_back([&, t]{
+            const auto key = folly::to<std::string>(t);
+            for (std::size_t i = 0; i < kPerThread; i++) {
+                replies[t].push_back(conn->Query(std::move(redis::Command::Create(false).Set(key,folly::to<std::string>(t,":",i)))));
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (std::size_t t = 0; t < kThreads; t++) {
+        for (std::size_t i = 0; i < kPerThread; i++) {
+            EXPECT_EQ(std::move(replies[t][i]).get().AsString(),folly::to<std::string>(t,":",i));
+        }
+    }
+    std::vector<std::size_t> next(kThreads,0);
+    const auto received = server.Received();
+    ASSERT_EQ(received.size(),kThreads * kPerThread);
+    for (auto& args : received) {
+        const auto t = folly::to<std::size_t>(args[1]);
+        EXPECT_EQ(args[2],folly::to<std::string>(t,":",next[t]++));
+    }
+    EXPECT_EQ(conn->Stats().inflight,0);
+}
+
+TEST(ConnTest,Timeout){
+    redis::test::FakeServer server;
+    auto conn = connect(server);
+
+    //已经写出的命令超时: future马上失败, 迟到的回包被丢弃, 后面的回包仍然按顺序对应
+    server.Pause();
+    auto late = conn->Query(std::move(get("late").SetTimeout(std::chrono::milliseconds(50))));
+    EXPECT_THROW(std::move(late).get(),folly::FutureTimeout);
+    auto next = conn->Query(get("next"));
+    ASSERT_TRUE(server.WaitFor(2));
+    server.Resume();
+    EXPECT_EQ(std::move(next).get().AsString(),"next");
+    EXPECT_EQ(conn->Stats().timeouts,1);
+    EXPECT_EQ(conn->Stats().unsent_timeouts,0);
+}
+
+TEST(ConnTest,DropUnsentExpired){
+    redis::test::FakeServer server;
+    auto conn = connect(server);
+
+    //IO线程忙的时候提交的命令, 轮到它时已经超时, 不再写出
+    folly::Baton<> blocked;
+    folly::Baton<> release;
+    conn->GetEventBase()->runInEventBaseThread([&]{
+        blocked.post();
+        release.wait();
+    });
+    blocked.wait();
+    auto dropped = conn->Query(std::move(get("dropped").SetTimeout(std::chrono::milliseconds(10))));
+    auto kept = conn->Query(get("kept"));
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    release.post();
+    EXPECT_THROW(std::move(dropped).get(),folly::FutureTimeout);
+    EXPECT_EQ(std::move(kept).get().AsString(),"kept");
+    const auto received = server.Received();
+    ASSERT_EQ(received.size(),1);
+    EXPECT_EQ(received[0][1],"kept");
+    EXPECT_EQ(conn->Stats().unsent_timeouts,1);
+}
+
+TEST(ConnTest,OverloadReject){
+    redis::test::FakeServer server;
+    redis::ConnLimits limits;
+    limits.max_inflight = 1;
+    auto conn = connect(server, false, limits);
+
+    //不等待时超过上限立即失败
+    server.Pause();
+    auto first = conn->Query(get("first"));
+    EXPECT_THROW(conn->Query(get("second")).get(),redis::ConnOverloaded);
+    EXPECT_EQ(conn->Stats().rejected,1);
+    server.Resume();
+    EXPECT_EQ(std::move(first).get().AsString(),"first");
+    EXPECT_EQ(conn->Query(get("third")).get().AsString(),"third");
+    EXPECT_EQ(conn->Stats().rejected,1);
+}
+
+TEST(ConnTest,WaiterOrder){
+    redis::test::FakeServer server;
+    redis::ConnLimits limits;
+    limits.max_inflight = 1;
+    limits.wait = true;
+    auto conn = connect(server, false, limits);
+
+    //等待空位的提交和WaitCapacity()按加入的顺序放行
+    server.Pause();
+    auto a = conn->Query(get("a"));
+    ASSERT_TRUE(server.WaitFor(1));
+    auto b = conn->Query(get("b"));
+    auto ready = conn->WaitCapacity();
+    auto c = conn->Query(get("c"));
+    EXPECT_EQ(conn->Stats().waiting,3);
+    EXPECT_FALSE(ready.isReady());
+    server.Resume();
+    EXPECT_EQ(std::move(a).get().AsString(),"a");
+    EXPECT_EQ(std::move(b).get().AsString(),"b");
+    EXPECT_EQ(std::move(c).get().AsString(),"c");
+    //ready在b完成之后, c提交之前放行
+    EXPECT_TRUE(ready.isReady());
+    const auto received = server.Received();
+    ASSERT_EQ(received.size(),3);
+    EXPECT_EQ(received[0][1],"a");
+    EXPECT_EQ(received[1][1],"b");
+    EXPECT_EQ(received[2][1],"c");
+    EXPECT_EQ(conn->Stats().waits,2);
+    EXPECT_EQ(conn->Stats().waiting,0);
+}
+
+TEST(ConnTest,CloseFailsPending){
+    redis::test::FakeServer server;
+    auto conn = connect(server);
+
+    //关闭时已经写出和还没提交的命令都失败
+    server.Pause();
+    auto pending = conn->Query(get("pending"));
+    ASSERT_TRUE(server.WaitFor(1));
+    conn->Close();
+    EXPECT_THROW(std::move(pending).get(),std::runtime_error);
+    EXPECT_THROW(conn->Query(get("after")).get(),std::runtime_error);
+}
@@ -0,0 +1,149 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <folly/SocketAddress.h>
+#include <folly/io/async/AsyncServerSocket.h>
+#include <folly/io/async/AsyncSocket.h>
+#include <folly/io/async/ScopedEventBaseThread.h>
+
+namespace redis::test
+{
+    /**
+     * 测试用的redis服务器, 在自己的IO线程上监听127.0.0.1的随机端口
+     * 只解析RESP数组形式的命令, 每个命令回一个bulk string, 内容是命令的最后一个参数
+     * Pause()后照常接收命令但是不回包, Resume()时按顺序补上
+     */
+    class FakeServer : folly::AsyncServerSocket::AcceptCallback
+    {
+    public:
+        using Args = std::vector<std::string>;
+        FakeServer() {
+            evb_thread_.getEventBase()->runInEventBaseThreadAndWait([this] {
+                auto* evb = evb_thread_.getEventBase();
+                server_ = folly::AsyncServerSocket::newSocket(evb);
+                server_->bind(folly::SocketAddress("127.0.0.1", 0));
+                server_->listen(16);
+                server_->addAcceptCallback(this, evb);
+                server_->startAccepting();
+                port_ = server_->getAddress().getPort();
+            });
+        }
+        ~FakeServer() override {
+            evb_thread_.getEventBase()->runInEventBaseThreadAndWait([this] {
+                sessions_.clear();
+                server_.reset();
+            });
+        }
+        FakeServer(const FakeServer&) = delete;
+        FakeServer& operator=(const FakeServer&) = delete;
+
+        uint16_t Port() const { return port_; }
+        //收到的命令, 按到达顺序
+        std::vector<Args> Received() const {
+            std::lock_guard<std::mutex> lock(mtx_);
+            return received_;
+        }
+        //等到至少收到n个命令, 超时返回false
+        bool WaitFor(std::size_t n, std::chrono::milliseconds timeout = std::chrono::seconds(5)) const {
+            std::unique_lock<std::mutex> lock(mtx_);
+            return cv_.wait_for(lock, timeout, [&] { return received_.size() >= n; });
+        }
+        void Pause() { paused_ = true; }
+        void Resume() {
+            evb_thread_.getEventBase()->runInEventBaseThreadAndWait([this] {
+                paused_ = false;
+                for (auto& session : sessions_) {
+                    session->flush();
+                }
+            });
+        }
+    private:
+        struct Session : folly::AsyncReader::ReadCallback
+        {
+            Session(FakeServer& server, folly::AsyncSocket::UniquePtr sock) : server_(server), sock_(std::move(sock)) {
+                sock_->setReadCB(this);
+            }
+            ~Session() override {
+                sock_->setReadCB(nullptr);
+            }
+            void getReadBuffer(void** bufReturn, size_t* lenReturn) override {
+                *bufReturn = buf_;
+                *lenReturn = sizeof(buf_);
+            }
+            void readDataAvailable(size_t len) noexcept override {
+                in_.append(buf_, len);
+                Args args;
+                while (parse(args)) {
+                    if (args.empty())continue;
+                    held_ += "$" + std::to_string(args.back().size()) + "\r\n" + args.back() + "\r\n";
+                    server_.record(std::move(args));
+                    args.clear();
+                }
+                if (!server_.paused_)flush();
+            }
+            void readEOF() noexcept override {}
+            void readErr(const folly::AsyncSocketException&) noexcept override {}
+            void flush() {
+                if (held_.empty())return;
+                sock_->write(nullptr, held_.data(), held_.size());
+                held_.clear();
+            }
+            //取出一个完整的命令, 不完整时不动in_
+            bool parse(Args& args) {
+                std::size_t pos = 0;
+                auto line = [&](int64_t& n, char type) {
+                    const auto end = in_.find("\r\n", pos);
+                    if (end == std::string::npos || in_[pos] != type)return false;
+                    n = std::stoll(in_.substr(pos + 1, end - pos - 1));
+                    pos = end + 2;
+                    return true;
+                };
+                int64_t argc = 0;
+                if (in_.empty() || !line(argc, '*'))return false;
+                for (int64_t i = 0; i < argc; i++) {
+                    int64_t len = 0;
+                    if (pos >= in_.size() || !line(len, '$'))return false;
+                    if (in_.size() < pos + len + 2)return false;
+                    args.emplace_back(in_, pos, len);
+                    pos += len + 2;
+                }
+                in_.erase(0, pos);
+                return true;
+            }
+            FakeServer& server_;
+            folly::AsyncSocket::UniquePtr sock_;
+            char buf_[4096];
+            std::string in_;
+            //还没写出的回包, 暂停时积累在这里
+            std::string held_;
+        };
+        void connectionAccepted(folly::NetworkSocket fd, const folly::SocketAddress&, AcceptInfo) noexcept override {
+            auto sock = folly::AsyncSocket::newSocket(evb_thread_.getEventBase(), fd);
+            sessions_.emplace_back(std::make_unique<Session>(*this, std::move(sock)));
+        }
+        void acceptError(const std::exception&) noexcept override {}
+        void record(Args&& args) {
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                received_.push_back(std::move(args));
+            }
+            cv_.notify_all();
+        }
+    private:
+        folly::ScopedEventBaseThread evb_thread_;
+        std::shared_ptr<folly::AsyncServerSocket> server_;
+        std::vector<std::unique_ptr<Session>> sessions_;
+        uint16_t port_{ 0 };
+        std::atomic<bool> paused_{ false };
+        mutable std::mutex mtx_;
+        mutable std::condition_variable cv_;
+        std::vector<Args> received_;
+    };
+}
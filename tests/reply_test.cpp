@@ -1,6 +1,12 @@
 #include <gtest/gtest.h>
 #include "redis/reply.h"
 #include "redis/builders.h"
+#include "redis/command.h"
+#include "redis/decoder.h"
+#include "redis/line_scanner.h"
+#include "redis/pool_client.h"
+#include "redis/prepared_command.h"
+#include "redis/slot_ring.h"
 
 TEST(ReplyTest,BasicAssertions){
     GTEST_EXPECT_TRUE(redis::Reply().IsNull());
@@ -27,6 +33,526 @@ TEST(ReplyTest,BasicAssertions){
 }
 
 TEST(BuildersTest,BasicAssertions){
+    folly::IOBufQueue buf(folly::IOBufQueue::cacheChainLength());
+    redis::ReplyBuilder builder(buf);
+    buf.append("+OK\r\n:42\r\n$5\r\nhello\r\n$-1\r\n-MOVED 3999 127.0.0.1:6381\r\n*0\r\n");
+    while (builder.Build());
 
+    auto rpl = builder.TakeFront();
+    GTEST_EXPECT_TRUE(rpl.IsSimpleString());
+    EXPECT_EQ(rpl.AsString(),"OK");
+
+    rpl = builder.TakeFront();
+    EXPECT_EQ(rpl.AsInteger(),42);
+
+    rpl = builder.TakeFront();
+    GTEST_EXPECT_TRUE(rpl.IsBulkString());
+    EXPECT_EQ(rpl.AsStringPiece(),"hello");
+
+    GTEST_EXPECT_TRUE(builder.TakeFront().IsNull());
+    GTEST_EXPECT_TRUE(builder.TakeFront().IsMovedError());
+
+    rpl = builder.TakeFront();
+    GTEST_EXPECT_TRUE(rpl.IsArray());
+    GTEST_EXPECT_TRUE(rpl.AsArray().empty());
+    GTEST_EXPECT_FALSE(builder.IsReplyAvailable());
+}
+
+TEST(BuildersTest,NestedArrayAcrossReads){
+    const std::string data = "*3\r\n*2\r\n$3\r\nfoo\r\n:1\r\n*1\r\n*1\r\n$0\r\n\r\n+bar\r\n";
+    folly::IOBufQueue buf(folly::IOBufQueue::cacheChainLength());
+    redis::ReplyBuilder builder(buf);
+    //one byte per read, the parser must keep its state between calls
+    for (std::size_t i = 0; i < data.size(); i++) {
+        buf.append(folly::IOBuf::copyBuffer(data.data() + i, 1));
+        bool built = builder.Build();
+        EXPECT_EQ(built, i == data.size() - 1);
+    }
+    auto rpl = builder.TakeFront();
+    auto& arr = rpl.AsArray();
+    ASSERT_EQ(arr.size(),3);
+    EXPECT_EQ(arr[0].AsArray()[0].AsString(),"foo");
+    EXPECT_EQ(arr[0].AsArray()[1].AsInteger(),1);
+    EXPECT_EQ(arr[1].AsArray()[0].AsArray()[0].AsString(),"");
+    EXPECT_EQ(arr[2].AsString(),"bar");
+    EXPECT_TRUE(buf.empty());
+}
+
+TEST(BuildersTest,ProtocolError){
+    folly::IOBufQueue buf(folly::IOBufQueue::cacheChainLength());
+    redis::ReplyBuilder builder(buf);
+    buf.append("?what\r\n");
+    EXPECT_THROW(builder.Build(),std::runtime_error);
+}
+
+
+TEST(ReplyTest,IOBufPayload){
+    auto single = folly::IOBuf::copyBuffer("hello world");
+    const auto* head = single->data();
+
+    redis::Reply rpl(std::move(single),redis::Reply::StringType::BulkString);
+    GTEST_EXPECT_TRUE(rpl.IsBulkString());
+
+    auto buf = rpl.AsIOBuf();
+    EXPECT_EQ(buf->data(),head);
+    EXPECT_EQ(buf->computeChainDataLength(),11);
+    EXPECT_EQ(rpl.AsStringPiece().data(),reinterpret_cast<const char*>(head));
+
+    //跨多个缓冲的payload在构造时合并成一块
+    auto chain = folly::IOBuf::copyBuffer("hello ");
+    chain->prependChain(folly::IOBuf::copyBuffer("world"));
+    rpl = redis::Reply(std::move(chain),redis::Reply::StringType::BulkString);
+    GTEST_EXPECT_FALSE(rpl.AsIOBuf()->isChained());
+    EXPECT_EQ(rpl.AsStringPiece(),"hello world");
+    EXPECT_EQ(rpl.AsString(),"hello world");
+
+    redis::Reply copy = rpl;
+    EXPECT_EQ(copy.AsStringPiece().data(),rpl.AsStringPiece().data());
+    EXPECT_EQ(std::move(copy).AsString(),"hello world");
+
+    rpl.set("plain",redis::Reply::StringType::SimpleString);
+    EXPECT_EQ(rpl.AsStringPiece(),"plain");
+    EXPECT_EQ(rpl.AsIOBuf()->computeChainDataLength(),5);
+}
+
+TEST(BuildersTest,SliceThreshold){
+    folly::IOBufQueue buf(folly::IOBufQueue::cacheChainLength());
+    redis::ReplyBuilder builder(buf);
+    const std::string big(redis::ReplyBuilder::kMinSliceSize,'x');
+    auto data = folly::IOBuf::copyBuffer("+OK\r\n$5\r\nhello\r\n$" + folly::to<std::string>(big.size()) + "\r\n" + big + "\r\n");
+    const auto* begin = reinterpret_cast<const char*>(data->data());
+    const auto* end = begin + data->length();
+    buf.append(std::move(data));
+    while (builder.Build());
+
+    //短行和小的payload是拷贝, 不引用读缓冲
+    auto ok = builder.TakeFront();
+    EXPECT_EQ(ok.AsStringPiece(),"OK");
+    GTEST_EXPECT_TRUE(ok.AsStringPiece().data() < begin || ok.AsStringPiece().data() >= end);
+    auto small = builder.TakeFront();
+    EXPECT_EQ(small.AsStringPiece(),"hello");
+    GTEST_EXPECT_TRUE(small.AsStringPiece().data() < begin || small.AsStringPiece().data() >= end);
+    //大的payload是读缓冲的切片
+    auto large = builder.TakeFront();
+    EXPECT_EQ(large.AsStringPiece().size(),big.size());
+    GTEST_EXPECT_TRUE(large.AsStringPiece().data() >= begin && large.AsStringPiece().data() < end);
+}
+
+TEST(LineScannerTest,ResumeAcrossBuffers){
+    folly::IOBufQueue buf(folly::IOBufQueue::cacheChainLength());
+    redis::LineScanner scanner;
+    const std::string line(100,'x');
+    buf.append("-"+line);
+    EXPECT_EQ(scanner.Find(buf),-1);
+    EXPECT_EQ(scanner.Scanned(),101);
+
+    //\r和\n分在两个buffer里
+    buf.append(folly::IOBuf::copyBuffer("\r"));
+    EXPECT_EQ(scanner.Find(buf),-1);
+    EXPECT_EQ(scanner.Scanned(),101);
+    buf.append(folly::IOBuf::copyBuffer("\n:12"));
+    EXPECT_EQ(scanner.Find(buf),101);
+
+    buf.trimStart(103);
+    scanner.Reset();
+    buf.append(folly::IOBuf::copyBuffer("34\r\n"));
+    EXPECT_EQ(scanner.Find(buf),5);
+    EXPECT_EQ(redis::ParseInteger(buf,1,4),1234);
+}
+
+TEST(LineScannerTest,LoneCRAtBufferEnd){
+    folly::IOBufQueue buf(folly::IOBufQueue::cacheChainLength());
+    redis::LineScanner scanner;
+    //\r在buffer末尾, 后面的buffer不是以\n开头, 要继续找后面的\r\n
+    buf.append(folly::IOBuf::copyBuffer("+a\r"));
+    EXPECT_EQ(scanner.Find(buf),-1);
+    EXPECT_EQ(scanner.Scanned(),2);
+    buf.append(folly::IOBuf::copyBuffer("x"));
+    EXPECT_EQ(scanner.Find(buf),-1);
+    EXPECT_EQ(scanner.Scanned(),4);
+    buf.append(folly::IOBuf::copyBuffer("yz\r\n"));
+    EXPECT_EQ(scanner.Find(buf),6);
+
+    //一次到齐的链
+    buf.clear();
+    scanner.Reset();
+    buf.append(folly::IOBuf::copyBuffer("+a\r"));
+    buf.append(folly::IOBuf::copyBuffer("xyz\r\n"));
+    EXPECT_EQ(scanner.Find(buf),6);
+}
+
+TEST(BuildersTest,Resp3){
+    folly::IOBufQueue buf(folly::IOBufQueue::cacheChainLength());
+    redis::ReplyBuilder builder(buf);
+    buf.append("%2\r\n+first\r\n:1\r\n$6\r\nsecond\r\n#t\r\n"
+               "~2\r\n,3.5\r\n_\r\n"
+               "|1\r\n+ttl\r\n:10\r\n(3492890328409238509324850943850943825024385\r\n"
+               "=15\r\ntxt:Some string\r\n"
+               "!9\r\nMOVED 1 x\r\n!0\r\n\r\n"
+               ">3\r\n$10\r\ninvalidate\r\n*1\r\n$3\r\nkey\r\n%0\r\n");
+    while (builder.Build());
+
+    auto rpl = builder.TakeFront();
+    GTEST_EXPECT_TRUE(rpl.IsMap());
+    ASSERT_EQ(rpl.AsArray().size(),4);
+    EXPECT_EQ(rpl.AsArray()[0].AsString(),"first");
+    EXPECT_EQ(rpl.AsArray()[1].AsInteger(),1);
+    EXPECT_EQ(rpl.AsArray()[3].AsBool(),true);
+
+    rpl = builder.TakeFront();
+    GTEST_EXPECT_TRUE(rpl.IsSet());
+    EXPECT_DOUBLE_EQ(rpl.AsArray()[0].AsDouble(),3.5);
+    GTEST_EXPECT_TRUE(rpl.AsArray()[1].IsNull());
+
+    //attribute被丢弃
+    rpl = builder.TakeFront();
+    EXPECT_EQ(rpl.GetType(),redis::Reply::Type::BigNumber);
+    EXPECT_EQ(rpl.AsString(),"3492890328409238509324850943850943825024385");
+
+    rpl = builder.TakeFront();
+    EXPECT_EQ(rpl.GetType(),redis::Reply::Type::Verbatim);
+    EXPECT_EQ(rpl.AsString(),"Some string");
+
+    GTEST_EXPECT_TRUE(builder.TakeFront().IsMovedError());
+    //空的blob error也是错误
+    GTEST_EXPECT_TRUE(builder.TakeFront().IsError());
+
+    rpl = builder.TakeFront();
+    GTEST_EXPECT_TRUE(rpl.IsPush());
+    EXPECT_EQ(rpl.AsArray()[0].AsString(),"invalidate");
+    GTEST_EXPECT_TRUE(rpl.AsArray()[2].IsMap());
+    GTEST_EXPECT_FALSE(builder.IsReplyAvailable());
+
+    //arena中的blob error
+    builder.SetArena(true);
+    buf.append("*2\r\n!5\r\nASK x\r\n!0\r\n\r\n");
+    GTEST_EXPECT_TRUE(builder.Build());
+    rpl = builder.TakeFront();
+    GTEST_EXPECT_TRUE(rpl.Rows()[0].IsAskError());
+    GTEST_EXPECT_TRUE(rpl.Rows()[1].IsError());
+}
+
+TEST(BuildersTest,StreamBulk){
+    folly::IOBufQueue buf(folly::IOBufQueue::cacheChainLength());
+    redis::ReplyBuilder builder(buf);
+    std::string received;
+    builder.SetChunkCallback([&received](std::unique_ptr<folly::IOBuf> chunk){
+        received += chunk->moveToFbString().toStdString();
+    });
+    buf.append("$10\r\n0123");
+    GTEST_EXPECT_FALSE(builder.Build());
+    EXPECT_EQ(received,"0123");
+    //payload已经交出去了, 读缓冲是空的
+    EXPECT_TRUE(buf.empty());
+    GTEST_EXPECT_TRUE(builder.InProgress());
+
+    buf.append("456789\r");
+    GTEST_EXPECT_FALSE(builder.Build());
+    buf.append("\n");
+    GTEST_EXPECT_TRUE(builder.Build());
+    EXPECT_EQ(received,"0123456789");
+    EXPECT_EQ(builder.TakeFront().AsString(),"");
+
+    //数组里的bulk string不走流式
+    buf.append("*1\r\n$2\r\nab\r\n");
+    GTEST_EXPECT_TRUE(builder.Build());
+    EXPECT_EQ(builder.TakeFront().AsArray()[0].AsString(),"ab");
+
+    //读了一半后去掉回调, 剩下的payload丢弃
+    received.clear();
+    buf.append("$6\r\nabc");
+    GTEST_EXPECT_FALSE(builder.Build());
+    builder.Detach();
+    buf.append("def\r\n+OK\r\n");
+    GTEST_EXPECT_TRUE(builder.Build());
+    EXPECT_EQ(received,"abc");
+    EXPECT_EQ(builder.TakeFront().AsString(),"");
+    GTEST_EXPECT_TRUE(builder.Build());
+    EXPECT_EQ(builder.TakeFront().AsString(),"OK");
 }
 
+
+TEST(DecoderTest,FromReply){
+    folly::IOBufQueue buf(folly::IOBufQueue::cacheChainLength());
+    redis::ReplyBuilder builder(buf);
+    buf.append("*3\r\n$1\r\na\r\n$-1\r\n:7\r\n");
+    GTEST_EXPECT_TRUE(builder.Build());
+    auto vals = redis::decode::FromReply<std::vector<std::optional<std::string>>>(builder.TakeFront());
+    ASSERT_EQ(vals.size(),3u);
+    EXPECT_EQ(vals[0].value(),"a");
+    GTEST_EXPECT_FALSE(vals[1].has_value());
+    EXPECT_EQ(vals[2].value(),"7");
+
+    //RESP2的平铺数组和RESP3的map都能解析成map
+    buf.append("%2\r\n+a\r\n:1\r\n$1\r\nb\r\n$2\r\n22\r\n");
+    GTEST_EXPECT_TRUE(builder.Build());
+    auto map = redis::decode::FromReply<std::unordered_map<std::string,int64_t>>(builder.TakeFront());
+    EXPECT_EQ(map.size(),2u);
+    EXPECT_EQ(map["a"],1);
+    EXPECT_EQ(map["b"],22);
+
+    //数组中的错误和类型不匹配都抛异常
+    buf.append("*1\r\n-ERR x\r\n:1\r\n");
+    GTEST_EXPECT_TRUE(builder.Build());
+    EXPECT_THROW(redis::decode::FromReply<std::vector<std::string>>(builder.TakeFront()),std::runtime_error);
+    GTEST_EXPECT_TRUE(builder.Build());
+    EXPECT_THROW(redis::decode::FromReply<std::vector<int64_t>>(builder.TakeFront()),std::runtime_error);
+}
+
+TEST(BuildersTest,TypedDecoder){
+    folly::IOBufQueue buf(folly::IOBufQueue::cacheChainLength());
+    redis::ReplyBuilder builder(buf);
+
+    redis::decode::TypedVisitor<std::vector<std::optional<std::string>>> list;
+    builder.SetVisitor(&list);
+    buf.append("*3\r\n$1\r\na\r\n$-1\r\n:7\r\n");
+    GTEST_EXPECT_TRUE(builder.Build());
+    GTEST_EXPECT_TRUE(builder.TakeFront().IsNull());
+    auto vals = list.Result();
+    ASSERT_EQ(vals.size(),3u);
+    EXPECT_EQ(vals[0].value(),"a");
+    GTEST_EXPECT_FALSE(vals[1].has_value());
+    EXPECT_EQ(vals[2].value(),"7");
+
+    //RESP2的平铺数组和RESP3的map都能解析成map, 前面的push不交给visitor
+    redis::decode::TypedVisitor<std::unordered_map<std::string,int64_t>> hash;
+    builder.SetVisitor(&hash);
+    buf.append(">2\r\n+message\r\n+x\r\n%2\r\n+a\r\n:1\r\n$1\r\nb\r\n$2\r\n22\r\n");
+    GTEST_EXPECT_TRUE(builder.Build());
+    GTEST_EXPECT_TRUE(builder.TakeFront().IsPush());
+    GTEST_EXPECT_TRUE(builder.Build());
+    builder.PopFront();
+    auto map = hash.Result();
+    EXPECT_EQ(map.size(),2u);
+    EXPECT_EQ(map["a"],1);
+    EXPECT_EQ(map["b"],22);
+
+    //类型不匹配只影响结果, 不影响后面的解析
+    redis::decode::TypedVisitor<int64_t> num;
+    builder.SetVisitor(&num);
+    buf.append("*1\r\n:1\r\n-ERR x\r\n");
+    GTEST_EXPECT_TRUE(builder.Build());
+    builder.PopFront();
+    EXPECT_THROW(num.Result(),std::runtime_error);
+    GTEST_EXPECT_TRUE(builder.Build());
+    GTEST_EXPECT_TRUE(builder.TakeFront().IsError());
+}
+
+namespace {
+    //ZRANGE WITHSCORES的分数求和
+    class ScoreSum : public redis::ReplyVisitor
+    {
+    public:
+        void onArrayBegin(int64_t, redis::Reply::Type) override {}
+        void onArrayEnd() override {}
+        void onBulk(folly::StringPiece str) override {
+            if (index++ % 2 == 1)sum += folly::to<double>(str);
+        }
+        void onInt(int64_t) override {}
+        void onNull() override {}
+        void onError(folly::StringPiece) override {}
+        int64_t index{0};
+        double sum{0};
+    };
+}
+
+TEST(BuildersTest,Visitor){
+    folly::IOBufQueue buf(folly::IOBufQueue::cacheChainLength());
+    redis::ReplyBuilder builder(buf);
+    ScoreSum visitor;
+    builder.SetVisitor(&visitor);
+    buf.append("*4\r\n$1\r\na\r\n$3\r\n1.5\r\n$1\r\nb\r\n$");
+    GTEST_EXPECT_FALSE(builder.Build());
+    buf.append("1\r\n2\r\n");
+    GTEST_EXPECT_TRUE(builder.Build());
+    GTEST_EXPECT_TRUE(builder.TakeFront().IsNull());
+    EXPECT_EQ(visitor.index,4);
+    EXPECT_DOUBLE_EQ(visitor.sum,3.5);
+
+    //解析了一半后去掉visitor, 剩下的不再回调
+    buf.append("*2\r\n$1\r\na\r\n");
+    GTEST_EXPECT_FALSE(builder.Build());
+    builder.Detach();
+    buf.append("$1\r\n9\r\n");
+    GTEST_EXPECT_TRUE(builder.Build());
+    GTEST_EXPECT_TRUE(builder.TakeFront().IsNull());
+    EXPECT_EQ(visitor.index,5);
+    EXPECT_DOUBLE_EQ(visitor.sum,3.5);
+    builder.SetVisitor(&visitor);
+
+    //顶层错误原样返回
+    buf.append("-MOVED 1 127.0.0.1:7000\r\n");
+    GTEST_EXPECT_TRUE(builder.Build());
+    GTEST_EXPECT_TRUE(builder.TakeFront().IsMovedError());
+}
+
+TEST(ReplyTest,Storage){
+    redis::Reply rpl;
+    rpl << redis::Reply(int64_t(1));
+    rpl << redis::Reply(folly::IOBuf::copyBuffer("ERR x"), redis::Reply::StringType::Error);
+    auto copy = rpl;
+    EXPECT_EQ(copy.AsArray()[1].Error(),"ERR x");
+    //用自己的子元素赋值
+    rpl = std::move(rpl.AsArray()[1]);
+    GTEST_EXPECT_TRUE(rpl.IsError());
+    EXPECT_EQ(rpl.AsStringPiece(),"ERR x");
+    EXPECT_EQ(copy.AsArray()[0].AsInteger(),1);
+    rpl.setBool(true);
+    GTEST_EXPECT_TRUE(rpl.AsBool());
+
+    const std::vector<redis::Reply> rows{redis::Reply(int64_t(2)),redis::Reply("x",redis::Reply::StringType::BulkString)};
+    rpl.set(rows);
+    std::vector<redis::Reply> moved = std::move(rpl).AsArray();
+    ASSERT_EQ(moved.size(),2);
+    EXPECT_EQ(moved[0].AsInteger(),2);
+    EXPECT_EQ(moved[1].AsString(),"x");
+}
+
+TEST(BuildersTest,Arena){
+    folly::IOBufQueue buf(folly::IOBufQueue::cacheChainLength());
+    redis::ReplyBuilder builder(buf);
+    builder.SetArena(true);
+    const std::string big(redis::ReplyBuilder::kArenaStringMax + 1, 'x');
+    const std::string data = "*2\r\n*2\r\n$6\r\nstream\r\n*1\r\n*2\r\n$3\r\n1-0\r\n*2\r\n+k\r\n-ASK 1 127.0.0.1:7000\r\n$"
+        + folly::to<std::string>(big.size()) + "\r\n" + big + "\r\n";
+    for (std::size_t i = 0; i < data.size(); i += 7) {
+        buf.append(folly::IOBuf::copyBuffer(data.data() + i, std::min<std::size_t>(7, data.size() - i)));
+        builder.Build();
+    }
+    GTEST_EXPECT_TRUE(builder.IsReplyAvailable());
+    redis::Reply copy;
+    redis::Reply::Array rows;
+    {
+        auto rpl = builder.TakeFront();
+        //arena中的数组只能用Rows()访问
+        EXPECT_THROW(rpl.AsArray(),std::runtime_error);
+        const auto& stream = rpl.Rows()[0];
+        EXPECT_EQ(stream.Rows()[0].AsStringPiece(),"stream");
+        const auto& entry = stream.Rows()[1].Rows()[0];
+        EXPECT_EQ(entry.Rows()[0].AsString(),"1-0");
+        GTEST_EXPECT_TRUE(entry.Rows()[1].Rows()[1].IsAskError());
+        EXPECT_EQ(rpl.Rows()[1].AsString(),big);
+        copy = stream;
+        rows = std::move(rpl).AsArray();
+    }
+    //拷贝出来的数据不依赖arena
+    EXPECT_EQ(copy.AsArray()[1].AsArray()[0].AsArray()[1].AsArray()[0].AsString(),"k");
+    EXPECT_EQ(rows[0].AsArray()[0].AsString(),"stream");
+    EXPECT_EQ(rows[1].AsStringPiece().size(),big.size());
+}
+
+TEST(CommandTest,Serialize){
+    const std::string big(8192,'v');
+    auto value = folly::IOBuf::copyBuffer(big);
+    const auto* payload = value->data();
+
+    auto cmd = redis::Command::Create(true);
+    cmd.Set("key",std::move(value)).HSet("hash","field",std::string_view("small")).Arg(42).Build();
+    auto buf = cmd.Serialize().move();
+    //大的value是引用, 没有拷贝
+    bool shared = false;
+    for (auto range : *buf) {
+        shared = shared || range.data() == payload;
+    }
+    GTEST_EXPECT_TRUE(shared);
+
+    buf->coalesce();
+    const std::string expect = "*3\r\n$3\r\nSET\r\n$3\r\nkey\r\n$8192\r\n" + big + "\r\n"
+        "*5\r\n$4\r\nHSET\r\n$4\r\nhash\r\n$5\r\nfield\r\n$5\r\nsmall\r\n$2\r\n42\r\n";
+    EXPECT_EQ(folly::StringPiece(folly::ByteRange(buf->data(),buf->length())),expect);
+
+    //string_view和IOBuf的重载序列化结果一样
+    auto view = redis::Command::Create(true);
+    view.SetAdvanced("k",std::string_view("v"),true,10,false,0,true,false).LSet("l",0,std::string_view("x")).Build();
+    auto iobuf = redis::Command::Create(true);
+    iobuf.SetAdvanced("k",folly::IOBuf::copyBuffer("v"),true,10,false,0,true,false)
+        .LSet("l",0,folly::IOBuf::copyBuffer("x")).Build();
+    ASSERT_EQ(view.Commands().size(),2);
+    EXPECT_EQ(view.Commands()[0].ToString(),"*6\r\n$3\r\nSET\r\n$1\r\nk\r\n$1\r\nv\r\n$2\r\nEX\r\n$2\r\n10\r\n$2\r\nNX\r\n");
+    EXPECT_EQ(view.Commands()[0].ToString(),iobuf.Commands()[0].ToString());
+    EXPECT_EQ(view.Commands()[1].ToString(),iobuf.Commands()[1].ToString());
+}
+
+TEST(CommandTest,Prepared){
+    redis::PreparedCommand incr(redis::Command::Create(false).HIncrby("stats:{0}","field",1),{1,3});
+    EXPECT_EQ(incr.Slots(),2);
+
+    auto buf = incr.Bind("stats:{12}",-42);
+    EXPECT_EQ(buf->countChainElements(),1);
+    EXPECT_EQ(folly::StringPiece(folly::ByteRange(buf->data(),buf->length())),
+        "*4\r\n$7\r\nHINCRBY\r\n$10\r\nstats:{12}\r\n$5\r\nfield\r\n$3\r\n-42\r\n");
+
+    //key是槽位, 绑定的值用来路由
+    auto pipe = redis::Command::Create(true);
+    incr.BindTo(pipe,std::string("stats:{3}"),7);
+    incr.BindTo(pipe,std::string_view("stats:{4}"),8);
+    ASSERT_EQ(pipe.Commands().size(),2);
+    EXPECT_EQ(pipe.Commands()[1].key,"stats:{4}");
+    EXPECT_EQ(pipe.Commands()[1].ToString(),"*4\r\n$7\r\nHINCRBY\r\n$9\r\nstats:{4}\r\n$5\r\nfield\r\n$1\r\n8\r\n");
+
+    EXPECT_THROW(incr.Bind("stats:{1}"),std::invalid_argument);
+
+    //按key的参数位置找槽位, 值和key相同的参数不是key
+    auto set = redis::Command::Create(false);
+    set.Set("same","same").Build();
+    EXPECT_EQ(set.Commands()[0].key_arg,1);
+    redis::PreparedCommand value(set,{2});
+    auto pipe2 = redis::Command::Create(true);
+    value.BindTo(pipe2,"other");
+    EXPECT_EQ(pipe2.Commands()[0].key,"same");
+}
+
+TEST(PoolClientTest,KeyAffine){
+    using redis::PoolClient;
+    //只哈希{hash tag}里的部分, 空的tag哈希整个key
+    EXPECT_EQ(PoolClient::KeyHash("{user1}:name"),PoolClient::KeyHash("{user1}:age"));
+    EXPECT_EQ(PoolClient::KeyHash("{user1}:name"),PoolClient::KeyHash("user1"));
+    EXPECT_EQ(PoolClient::KeyHash("{}user1"),std::hash<std::string_view>()("{}user1"));
+    EXPECT_EQ(PoolClient::KeyHash("user1{"),std::hash<std::string_view>()("user1{"));
+
+    //没有key
+    EXPECT_EQ(PoolClient::AffineIndex(redis::Command::Create(false).Cmd("PING").Build(),4),PoolClient::kNoKey);
+    auto same = redis::Command::Create(true);
+    same.Get("{user1}:name").Get("{user1}:age").Cmd("PING");
+    same.Build();
+    EXPECT_EQ(PoolClient::AffineIndex(same,4),static_cast<int64_t>(PoolClient::KeyHash("user1") % 4));
+
+    //找两个落到不同连接的key, 同一个pipeline里要拒绝, 不抛异常
+    std::string other;
+    for (int i = 0; i < 64 && other.empty(); i++) {
+        auto key = folly::to<std::string>("key", i);
+        if (PoolClient::KeyHash(key) % 4 != PoolClient::KeyHash("user1") % 4)other = key;
+    }
+    ASSERT_FALSE(other.empty());
+    auto split = redis::Command::Create(true);
+    split.Get("user1").Get(other);
+    split.Build();
+    EXPECT_EQ(PoolClient::AffineIndex(split,4),PoolClient::kMixedKeys);
+}
+
+TEST(SlotRingTest,Wrap){
+    redis::SlotRing<std::unique_ptr<int>> ring(4);
+    EXPECT_EQ(ring.capacity(),4);
+    for (int i = 0; i < 3; i++) {
+        ring.push_back(std::make_unique<int>(i));
+    }
+    ring.pop_front();
+    ring.pop_front();
+    //跨过环的末尾
+    ring.push_back(std::make_unique<int>(3));
+    ring.push_back(std::make_unique<int>(4));
+    ring.push_front(std::make_unique<int>(1));
+    EXPECT_EQ(ring.capacity(),4);
+    ASSERT_EQ(ring.size(),4);
+    for (std::size_t i = 0; i < ring.size(); i++) {
+        EXPECT_EQ(*ring[i],static_cast<int>(i) + 1);
+    }
+    //满了翻倍, 元素可以来自环本身
+    ring.push_back(std::move(ring.front()));
+    EXPECT_EQ(ring.capacity(),8);
+    ASSERT_EQ(ring.size(),5);
+    EXPECT_EQ(ring.front(),nullptr);
+    EXPECT_EQ(*ring[4],1);
+    ring.pop_front();
+    EXPECT_EQ(*ring.front(),2);
+}